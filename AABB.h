@@ -0,0 +1,18 @@
+#ifndef _AABB_INCLUDE
+#define _AABB_INCLUDE
+
+#include <glm/glm.hpp>
+
+// Axis aligned bounding box
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+inline float surfaceArea(const AABB &aabb)
+{
+    glm::vec3 size = glm::max(aabb.max - aabb.min, glm::vec3(0.0f));
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+#endif // _AABB_INCLUDE
@@ -0,0 +1,83 @@
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef COUNT_ALLOCATIONS
+
+// Per thread, so that work in the background (hierarchy rebuilds) does not count for the frame
+static thread_local long long allocations = 0;
+
+static void *countedAllocation(std::size_t size)
+{
+    ++allocations;
+    void *p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(std::size_t size)
+{
+    return countedAllocation(size);
+}
+
+void *operator new[](std::size_t size)
+{
+    return countedAllocation(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    ++allocations;
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    ++allocations;
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+long long heapAllocations()
+{
+    return allocations;
+}
+
+bool countingAllocations()
+{
+    return true;
+}
+
+#else
+
+long long heapAllocations()
+{
+    return 0;
+}
+
+bool countingAllocations()
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _ALLOCATION_COUNTER_INCLUDE
+#define _ALLOCATION_COUNTER_INCLUDE
+
+// Number of heap allocations (global operator new) made so far by the calling thread
+// Only counted when built with COUNT_ALLOCATIONS (debug builds), otherwise always zero
+long long heapAllocations();
+bool countingAllocations();
+
+#endif // _ALLOCATION_COUNTER_INCLUDE
@@ -6,8 +6,9 @@
 #include <GL/glew.h>
 
 #include <fstream>
+#include <iostream>
 
-void Application::init()
+void Application::init(const CommandLineOptions &options)
 {
     bPlay = true;
     glClearColor(1.f, 1.f, 1.f, 1.0f);
@@ -29,6 +30,40 @@ void Application::init()
     time = 0;
     frames = 0;
     fps = 0.0f;
+
+    if (options.gridSize != 0) scene.setGridSize(options.gridSize);
+    if (!options.scenePath.empty() && !scene.loadScene(options.scenePath))
+        std::cerr << "Couldn't load scene " << options.scenePath << ", using the grid" << std::endl;
+    if (options.occlusionCulling != -1) scene.setOcclusionCulling(options.occlusionCulling);
+    if (options.hierarchyType != -1) scene.setHierarchyType(options.hierarchyType);
+    if (options.quadtreeLayout != -1) scene.setQuadtreeLayout(options.quadtreeLayout);
+    scene.setFrustumCulling(options.frustumCulling);
+    scene.setValidationMode(options.validationMode);
+    scene.setAnimation(options.animate);
+    scene.setPipelined(options.pipelined);
+    scene.setMeshletCulling(options.meshletCulling);
+    if (options.perfCounters) scene.setPerfCounters(true);
+
+    // Unattended run, replay the path and quit once it has been recorded
+    // It starts when the meshes of the scene have been loaded, until then their proxies are drawn instead
+    quitAfterRecord = false;
+    replayPath = options.replayPath;
+    replayFpsPath = options.fpsOutputPath;
+    replayStatsPath = options.statsOutputPath;
+}
+
+void Application::beginUnattendedReplay()
+{
+    int duration = scene.getCamera().beginReplay(replayPath);
+    if (duration <= 0) {
+        std::cerr << "Couldn't replay path " << replayPath << std::endl;
+        bPlay = false;
+    }
+    else {
+        beginRecordFps(replayFpsPath, replayStatsPath, duration);
+        quitAfterRecord = true;
+    }
+    replayPath.clear();
 }
 
 bool Application::loadMesh(const char *filename)
@@ -38,7 +73,9 @@ bool Application::loadMesh(const char *filename)
 
 bool Application::update(int deltaTime)
 {
+    if (!replayPath.empty() && !scene.isLoadingMeshes()) beginUnattendedReplay();
     scene.update(deltaTime);
+    lastDeltaTime = deltaTime;
     updateFrameRate(deltaTime);
     return bPlay;
 }
@@ -67,10 +104,11 @@ void Application::updateFrameRate(int deltaTime)
     }
 }
 
-void Application::beginRecordFps(const std::string &filePath, int duration)
+void Application::beginRecordFps(const std::string &filePath, const std::string &statsFilePath, int duration)
 {
     recordMode = true;
     recordFilePath = filePath;
+    recordStatsFilePath = statsFilePath;
     recordCheckpoints = duration;
     recordTimeSinceLastCheckpoint = 250;
     recordAccumulatedTime = 0;
@@ -91,16 +129,75 @@ void Application::endRecordFps()
     }
     recordTime.clear();
     recordFps.clear();
+
+    if (!recordStatsFilePath.empty()) {
+        std::ofstream statsOut(recordStatsFilePath);
+        if (statsOut.is_open()) {
+            statsOut << "# time frame_ms ";
+            RenderStats::writeHeader(statsOut);
+            statsOut << '\n';
+            int n = recordStats.size();
+            for (int i = 0; i < n; ++i) {
+                statsOut << recordFrameTimes[i]/1000.0f << ' ' << recordFrameDeltas[i] << ' ';
+                recordStats[i].write(statsOut);
+                statsOut << '\n';
+            }
+        }
+    }
+    recordFrameTimes.clear();
+    recordFrameDeltas.clear();
+    recordStats.clear();
+
+    if (quitAfterRecord) bPlay = false;
+}
+
+// Stores the statistics of the frame that has just been rendered
+void Application::recordFrameStats()
+{
+    RenderStats stats = scene.getStats();
+
+    // The accuracy arrives one frame late, store it with the frame it belongs to
+    if (!recordStats.empty()) recordStats.back().validation = stats.validation;
+    stats.validation.clear();
+
+    recordFrameTimes.push_back(recordAccumulatedTime);
+    recordFrameDeltas.push_back(lastDeltaTime);
+    recordStats.push_back(stats);
 }
 
 void Application::render()
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     int rendered = scene.render();
+    if (recordMode) recordFrameStats();
 
     if (ImGui::Begin("Performance Statistics")) {
+        const RenderStats &stats = scene.getStats();
         ImGui::Text("%g fps", fps);
         ImGui::Text("Rendered copies: %i", rendered);
+        ImGui::Separator();
+        ImGui::Text("Draw calls: %i", stats.drawCalls);
+        ImGui::Text("Mesh triangles: %lld", stats.meshTriangles);
+        ImGui::Text("Proxy triangles: %lld", stats.proxyTriangles);
+        ImGui::Text("Queries issued: %i", stats.queriesIssued);
+        ImGui::Text("Queries ready/blocked: %i/%i", stats.queriesReady, stats.queriesBlocked);
+        ImGui::Text("Time blocked: %.3f ms", stats.blockedTime);
+        ImGui::Text("Nodes traversed: %i", stats.nodesTraversed);
+        ImGui::Text("Nodes frustum culled: %i", stats.nodesFrustumCulled);
+        ImGui::Text("Meshlets culled: %i", stats.meshletsCulled);
+        if (stats.validation.visible != -1) {
+            ImGui::Separator();
+            ImGui::Text("Visible (previous frame): %i", stats.validation.visible);
+            ImGui::Text("False positives/negatives: %i/%i", stats.validation.falsePositives, stats.validation.falseNegatives);
+        }
+        for (int i = 0; i < NUM_PERF_PHASES; ++i) {
+            const PerfCounts &counts = stats.perf[i];
+            if (counts.cycles == 0) continue;
+            ImGui::Separator();
+            ImGui::Text("%s", PerfCounters::phaseName(static_cast<PerfPhase>(i)));
+            ImGui::Text("  cycles: %lld instructions: %lld", counts.cycles, counts.instructions);
+            ImGui::Text("  cache misses: %lld branch misses: %lld", counts.cacheMisses, counts.branchMisses);
+        }
     }
     ImGui::End();
 
@@ -116,9 +213,10 @@ void Application::render()
     if (ImGui::Begin("Replay Path")) {
         ImGui::InputText("Input Path File", inputPathBuff, IM_ARRAYSIZE(inputPathBuff));
         ImGui::InputText("Output FPS File", outputFpsBuff, IM_ARRAYSIZE(outputFpsBuff));
+        ImGui::InputText("Output Stats File", outputStatsBuff, IM_ARRAYSIZE(outputStatsBuff));
         if (ImGui::Button("Replay")) {
             int duration = scene.getCamera().beginReplay(inputPathBuff);
-            beginRecordFps(outputFpsBuff, duration);
+            beginRecordFps(outputFpsBuff, outputStatsBuff, duration);
         }
     }
     ImGui::End();
@@ -130,7 +228,7 @@ void Application::resize(int width, int height)
     this->width = width;
     this->height = height;
     glViewport(0, 0, width, height);
-    scene.getCamera().resizeCameraViewport(width, height);
+    scene.resize(width, height);
 }
 
 void Application::keyPressed(int key)
@@ -1,6 +1,7 @@
 #ifndef _APPLICATION_INCLUDE
 #define _APPLICATION_INCLUDE
 
+#include "CommandLine.h"
 #include "Scene.h"
 
 #include <string>
@@ -21,7 +22,7 @@ public:
         return G;
     }
 
-    void init();
+    void init(const CommandLineOptions &options);
     bool loadMesh(const char *filename);
     bool update(int deltaTime);
     void render();
@@ -43,12 +44,14 @@ public:
     int getWidth() const;
     int getHeight() const;
 
-    void beginRecordFps(const std::string &filePath, int duration);
+    void beginRecordFps(const std::string &filePath, const std::string &statsFilePath, int duration);
     void endRecordFps();
 
 private:
 
     void updateFrameRate(int deltaTime);
+    void recordFrameStats();
+    void beginUnattendedReplay();
     bool bPlay;						  // Continue?
     Scene scene;					  // Scene to render
     bool keys[256], specialKeys[256]; // Store key states so that we can have access at any time
@@ -66,6 +69,7 @@ private:
     char inputPathBuff[64];
     char outputPathBuff[64];
     char outputFpsBuff[64];
+    char outputStatsBuff[64];
     int pathDuration;
 
     // FPS measuring data
@@ -76,12 +80,21 @@ private:
 
     // FPS recording data
     bool recordMode;
+    bool quitAfterRecord;
+    std::string replayPath, replayFpsPath, replayStatsPath;     // Unattended replay waiting for the meshes
     std::string recordFilePath;
     std::vector<float> recordTime;
     std::vector<float> recordFps;
     int recordCheckpoints;
     int recordTimeSinceLastCheckpoint;
     int recordAccumulatedTime;
+
+    // Per frame statistics recording data
+    std::string recordStatsFilePath;
+    std::vector<int> recordFrameTimes;
+    std::vector<int> recordFrameDeltas;
+    std::vector<RenderStats> recordStats;
+    int lastDeltaTime;
 };
 
 #endif // _APPLICATION_INCLUDE
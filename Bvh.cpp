@@ -0,0 +1,291 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+// Subtrees with more objects are built as jobs that idle workers can steal, down to PARALLEL_LEVELS levels
+static const int PARALLEL_LEVELS = 6;
+static const int PARALLEL_MIN_OBJECTS = 4096;
+
+struct Bvh::BuildData
+{
+    const std::vector<AABB> &bounds;
+    std::vector<glm::vec3> centers;
+    std::vector<int> &objects;
+    JobSystem *jobs;
+};
+
+
+static void grow(AABB &aabb, const AABB &other)
+{
+    aabb.min = glm::min(aabb.min, other.min);
+    aabb.max = glm::max(aabb.max, other.max);
+}
+
+static AABB emptyAABB()
+{
+    AABB aabb;
+    aabb.min = glm::vec3(std::numeric_limits<float>::max());
+    aabb.max = glm::vec3(-std::numeric_limits<float>::max());
+    return aabb;
+}
+
+
+void Bvh::build(const std::vector<AABB> &objectBounds, unsigned int currentFrame, JobSystem *jobs)
+{
+    int count = objectBounds.size();
+    objects.resize(count);
+    objectLeaf.resize(count);
+    for (int i = 0; i < count; ++i) objects[i] = i;
+
+    BuildData data = {objectBounds, std::vector<glm::vec3>(count), objects, jobs};
+    for (int i = 0; i < count; ++i)
+        data.centers[i] = (objectBounds[i].min + objectBounds[i].max) / 2.0f;
+
+    nodes.clear();
+    nodes.reserve(2 * count);
+    build(data, nodes, 0, count, -1, 0);
+
+    // Parents come before their children in depth first order
+    std::vector<int> level(nodes.size(), 0);
+    depth = 0;
+    maxLeafObjects = 0;
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        BvhNode &node = nodes[i];
+        node.visible = true;
+        node.lastVisited = currentFrame;
+        if (node.parent != -1) level[i] = level[node.parent] + 1;
+        depth = std::max(depth, level[i]);
+        if (isLeaf(i)) {
+            maxLeafObjects = std::max(maxLeafObjects, numObjects(i));
+            for (int k = node.firstObject; k < node.lastObject; ++k) objectLeaf[objects[k]] = i;
+        }
+    }
+
+    dirty.assign(nodes.size(), 0);
+    dirtyNodes.clear();
+    dirtyNodes.reserve(nodes.size());
+    weightedArea = 0.0;
+    for (std::size_t i = 0; i < nodes.size(); ++i) weightedArea += nodeCost(i);
+    buildCost = getCost();
+}
+
+
+// Inner nodes cost a traversal step and leaves a test per object, both weighted by their area
+double Bvh::nodeCost(BvhNodeIndex i)
+{
+    if (isEmpty(i)) return 0.0;
+    return surfaceArea(nodes[i].aabb) * (isLeaf(i) ? numObjects(i) : 1);
+}
+
+
+float Bvh::getCost() const
+{
+    float rootArea = nodes.empty() ? 0.0f : surfaceArea(nodes[0].aabb);
+    return rootArea > 0.0f ? weightedArea / rootArea : 0.0f;
+}
+
+
+void Bvh::refitNode(const std::vector<AABB> &objectBounds, BvhNodeIndex i)
+{
+    BvhNode &node = nodes[i];
+    if (isEmpty(i)) return;
+    weightedArea -= nodeCost(i);
+    if (isLeaf(i)) {
+        node.aabb = objectBounds[objects[node.firstObject]];
+        for (int k = node.firstObject + 1; k < node.lastObject; ++k) grow(node.aabb, objectBounds[objects[k]]);
+    }
+    else {
+        node.aabb = nodes[i + 1].aabb;
+        grow(node.aabb, nodes[nodes[i + 1].skip].aabb);
+    }
+    weightedArea += nodeCost(i);
+}
+
+
+void Bvh::refit(const std::vector<AABB> &objectBounds, const std::vector<int> &movedObjects)
+{
+    // Every moved object dirties the path from its leaf to the root, shared parts only once
+    for (int object : movedObjects) {
+        int i = objectLeaf[object];
+        while (i != -1 && !dirty[i]) {
+            dirty[i] = 1;
+            dirtyNodes.push_back(i);
+            i = nodes[i].parent;
+        }
+    }
+
+    // Children come after their parents in depth first order, so they are refitted in decreasing index order
+    // (scanning the flags when many nodes are dirty, sorting the dirty ones otherwise)
+    int numNodes = dirty.size();
+    if (8 * dirtyNodes.size() > dirty.size()) {
+        for (int i = numNodes - 1; i >= 0; --i) {
+            if (!dirty[i]) continue;
+            refitNode(objectBounds, i);
+            dirty[i] = 0;
+        }
+    }
+    else {
+        std::sort(dirtyNodes.begin(), dirtyNodes.end(), std::greater<int>());
+        for (int i : dirtyNodes) {
+            refitNode(objectBounds, i);
+            dirty[i] = 0;
+        }
+    }
+    dirtyNodes.clear();
+}
+
+
+void Bvh::refitAll(const std::vector<AABB> &objectBounds)
+{
+    for (std::size_t i = nodes.size(); i-- > 0;) refitNode(objectBounds, i);
+    weightedArea = 0.0;
+    for (std::size_t i = 0; i < nodes.size(); ++i) weightedArea += nodeCost(i);
+}
+
+
+// Builds the subtree of objects [first, last) at the end of out, in depth first order
+void Bvh::build(BuildData &data, std::vector<BvhNode> &out, int first, int last, int parent, int level)
+{
+    int nodeIndex = out.size();
+    out.emplace_back();
+
+    AABB aabb = emptyAABB();
+    AABB centerBounds = emptyAABB();
+    for (int i = first; i < last; ++i) {
+        int object = data.objects[i];
+        grow(aabb, data.bounds[object]);
+        centerBounds.min = glm::min(centerBounds.min, data.centers[object]);
+        centerBounds.max = glm::max(centerBounds.max, data.centers[object]);
+    }
+    out[nodeIndex].aabb = aabb;
+    out[nodeIndex].parent = parent;
+    out[nodeIndex].firstObject = first;
+    out[nodeIndex].lastObject = last;
+
+    int count = last - first;
+    if (count <= 1) {
+        out[nodeIndex].skip = nodeIndex + 1;
+        return;
+    }
+
+    // Binned SAH: the objects are binned by their centers along every axis and the cost of splitting
+    // at every bin boundary is area(left) * count(left) + area(right) * count(right)
+    // Small nodes use fewer bins, clearing and sweeping all of them would dominate the build
+    int numBins = count < NUM_BINS ? count : NUM_BINS;
+    glm::vec3 extent = centerBounds.max - centerBounds.min;
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; ++axis)
+        scale[axis] = extent[axis] > 0.0f ? numBins / extent[axis] : 0.0f;
+
+    // One pass over the objects fills the bins of the three axes
+    int binCount[3][NUM_BINS] = {};
+    AABB binBounds[3][NUM_BINS];
+    for (int axis = 0; axis < 3; ++axis)
+        for (int bin = 0; bin < numBins; ++bin) binBounds[axis][bin] = emptyAABB();
+    for (int i = first; i < last; ++i) {
+        int object = data.objects[i];
+        const AABB &bounds = data.bounds[object];
+        glm::vec3 offset = (data.centers[object] - centerBounds.min) * scale;
+        for (int axis = 0; axis < 3; ++axis) {
+            int bin = std::min(numBins - 1, int(offset[axis]));
+            ++binCount[axis][bin];
+            grow(binBounds[axis][bin], bounds);
+        }
+    }
+
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    int bestBin = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (extent[axis] <= 0.0f) continue;
+
+        // Sweep from the right to get the area and count of every right side
+        float rightArea[NUM_BINS];
+        int rightCount[NUM_BINS];
+        AABB right = emptyAABB();
+        int rightObjects = 0;
+        for (int bin = numBins - 1; bin > 0; --bin) {
+            grow(right, binBounds[axis][bin]);
+            rightObjects += binCount[axis][bin];
+            rightArea[bin] = surfaceArea(right);
+            rightCount[bin] = rightObjects;
+        }
+
+        AABB left = emptyAABB();
+        int leftObjects = 0;
+        for (int bin = 1; bin < numBins; ++bin) {
+            grow(left, binBounds[axis][bin - 1]);
+            leftObjects += binCount[axis][bin - 1];
+            if (leftObjects == 0 || rightCount[bin] == 0) continue;
+            float cost = surfaceArea(left) * leftObjects + rightArea[bin] * rightCount[bin];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = bin;
+            }
+        }
+    }
+
+    // Small nodes stay as leaves when splitting does not pay off
+    float leafCost = surfaceArea(aabb) * count;
+    if (count <= MAX_LEAF_OBJECTS && (bestAxis == -1 || leafCost <= bestCost)) {
+        out[nodeIndex].skip = nodeIndex + 1;
+        return;
+    }
+
+    int middle;
+    if (bestAxis == -1) middle = first + count / 2; // All the centers at the same point
+    else {
+        float axisScale = scale[bestAxis];
+        float minCenter = centerBounds.min[bestAxis];
+        auto onLeft = [&](int object) {
+            return std::min(numBins - 1, int((data.centers[object][bestAxis] - minCenter) * axisScale)) < bestBin;
+        };
+        middle = std::partition(data.objects.begin() + first, data.objects.begin() + last, onLeft) - data.objects.begin();
+    }
+
+    // The two halves work on disjoint ranges of the objects, so large ones can be built in parallel
+    if (data.jobs && level < PARALLEL_LEVELS && count >= PARALLEL_MIN_OBJECTS) {
+        std::vector<BvhNode> leftNodes, rightNodes;
+        auto buildLeft = [&]() {build(data, leftNodes, first, middle, -1, level + 1);};
+        JobGroup group;
+        data.jobs->spawn(group, buildLeft);
+        build(data, rightNodes, middle, last, -1, level + 1);
+        data.jobs->wait(group);
+        append(out, leftNodes, nodeIndex);
+        append(out, rightNodes, nodeIndex);
+    }
+    else {
+        build(data, out, first, middle, nodeIndex, level + 1);
+        build(data, out, middle, last, nodeIndex, level + 1);
+    }
+    out[nodeIndex].skip = out.size();
+}
+
+
+// Moves a subtree built on its own (root at 0 without parent) to the end of out
+void Bvh::append(std::vector<BvhNode> &out, const std::vector<BvhNode> &subtree, int parent)
+{
+    int offset = out.size();
+    for (BvhNode node : subtree) {
+        node.parent = (node.parent == -1) ? parent : node.parent + offset;
+        node.skip += offset;
+        out.push_back(node);
+    }
+}
+
+
+int Bvh::childrenFrontToBack(BvhNodeIndex i, const glm::vec3 &viewpoint, BvhNodeIndex children[4]) const
+{
+    BvhNodeIndex first = i + 1;
+    BvhNodeIndex second = nodes[first].skip;
+    const AABB &a = nodes[first].aabb;
+    const AABB &b = nodes[second].aabb;
+    float distanceFirst = glm::distance(viewpoint, (a.min + a.max) / 2.0f);
+    float distanceSecond = glm::distance(viewpoint, (b.min + b.max) / 2.0f);
+    children[0] = distanceFirst <= distanceSecond ? first : second;
+    children[1] = distanceFirst <= distanceSecond ? second : first;
+    return 2;
+}
@@ -0,0 +1,114 @@
+#ifndef _BVH_INCLUDE
+#define _BVH_INCLUDE
+
+#include "AABB.h"
+#include "JobSystem.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+struct BvhNode
+{
+    AABB aabb;              // Bounds of the objects below the node
+    int parent;             // -1 for the root
+    int skip;               // Next node after the subtree in depth first order (nodes.size() at the end)
+    int firstObject;        // Objects [firstObject, lastObject) of Bvh::objects below the node
+    int lastObject;
+    bool visible;
+    unsigned int lastVisited;
+};
+
+using BvhNodeIndex = std::size_t;
+
+// Binary bounding volume hierarchy over arbitrary objects, built top down with a binned surface area heuristic
+// The nodes are stored in depth first order: the first child of a node follows it and the second one is
+// found at the skip index of the first, so a traversal that culls a subtree jumps to its skip index (stackless)
+struct Bvh
+{
+    static const int NUM_BINS = 16;
+    static const int MAX_LEAF_OBJECTS = 4;
+
+    std::vector<BvhNode> nodes;
+    std::vector<int> objects;       // Object ids grouped by leaf
+
+    // With a job system the top levels of large hierarchies are built in parallel
+    void build(const std::vector<AABB> &objectBounds, unsigned int currentFrame, JobSystem *jobs = nullptr);
+
+    // Bottom up update of the bounds of the leaves of the moved objects and of their ancestors,
+    // the topology and the visibility state of the nodes are kept
+    void refit(const std::vector<AABB> &objectBounds, const std::vector<int> &movedObjects);
+    void refitAll(const std::vector<AABB> &objectBounds);
+
+    // Surface area heuristic cost relative to the area of the root, kept up to date by the refits
+    float getCost() const;
+    float getBuildCost() const {return buildCost;}
+
+    // Children of a node in front to back order from the viewpoint, returns their number
+    int childrenFrontToBack(BvhNodeIndex i, const glm::vec3 &viewpoint, BvhNodeIndex children[4]) const;
+
+    int getDepth() const {return depth;}
+    int getMaxLeafObjects() const {return maxLeafObjects;}
+
+    std::size_t size() const
+    {
+        return nodes.size();
+    }
+
+    BvhNodeIndex root()
+    {
+        return 0;
+    }
+
+    BvhNodeIndex parent(BvhNodeIndex i)
+    {
+        return nodes[i].parent;
+    }
+
+    bool hasParent(BvhNodeIndex i)
+    {
+        return i > 0;
+    }
+
+    bool isLeaf(BvhNodeIndex i)
+    {
+        return nodes[i].skip == static_cast<int>(i) + 1;
+    }
+
+    bool isEmpty(BvhNodeIndex i)
+    {
+        return nodes[i].firstObject == nodes[i].lastObject;
+    }
+
+    int numObjects(BvhNodeIndex i)
+    {
+        return nodes[i].lastObject - nodes[i].firstObject;
+    }
+
+    const AABB &getAABB(BvhNodeIndex i) const {return nodes[i].aabb;}
+    int getFirstObject(BvhNodeIndex i) const {return nodes[i].firstObject;}
+    int getLastObject(BvhNodeIndex i) const {return nodes[i].lastObject;}
+
+    bool isVisible(BvhNodeIndex i) const {return nodes[i].visible;}
+    bool isVisibleInFrame(BvhNodeIndex i, unsigned int frame) const {return nodes[i].visible && nodes[i].lastVisited == frame;}
+    void setVisible(BvhNodeIndex i, bool visible) {nodes[i].visible = visible;}
+    void setState(BvhNodeIndex i, bool visible, unsigned int frame) {nodes[i].visible = visible; nodes[i].lastVisited = frame;}
+
+private:
+    struct BuildData;
+    static void build(BuildData &data, std::vector<BvhNode> &out, int first, int last, int parent, int level);
+    static void append(std::vector<BvhNode> &out, const std::vector<BvhNode> &subtree, int parent);
+    double nodeCost(BvhNodeIndex i);
+    void refitNode(const std::vector<AABB> &objectBounds, BvhNodeIndex i);
+
+private:
+    int depth;
+    int maxLeafObjects;
+    std::vector<int> objectLeaf;
+    std::vector<unsigned char> dirty;
+    std::vector<int> dirtyNodes;
+    double weightedArea;
+    float buildCost;
+};
+
+#endif // _BVH_INCLUDE
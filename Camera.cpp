@@ -27,6 +27,9 @@ void Camera::init()
     near = 0.01f;
     far = 100.0f;
     fov = 60.f / 180.f * glm::pi<float>();
+
+    recordMode = false;
+    replayMode = false;
     
     int width = Application::instance().getWidth();
     int height = Application::instance().getHeight();
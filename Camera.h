@@ -12,6 +12,15 @@ struct Frustum
     std::array<glm::vec4, 6> planes;
 };
 
+// What a frame needs of the camera, copied so that the frame can be prepared or submitted while the camera moves
+struct CameraSnapshot
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 position;
+    Frustum frustum;
+};
+
 // Camera contains the properies of the camera the scene is using
 // It is responsible for computing the associated GL matrices
 class Camera
@@ -34,13 +43,16 @@ public:
     const glm::mat4 &getViewMatrix() const {return view;}
     const glm::mat4 &getProjectionMatrix() const {return projection;}
     const Frustum &getFrustum() const {return frustum;}
+    CameraSnapshot getSnapshot() const {return {view, projection, position, frustum};}
+
+    // Computes the planes of the frustum in world space coordinates
+    void updateFrustum();
 private:
     void moveForward(float input, int deltaTime);
     void moveRight(float input, int deltaTime);
     void moveUp(float input, int deltaTime);
     // void savePath();
     void updateViewMatrix();
-    void updateFrustum();
 private:
     // OpenGL matrices
     glm::mat4 view;
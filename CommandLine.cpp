@@ -0,0 +1,102 @@
+#include "CommandLine.h"
+#include "Scene.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static bool parseStrategy(const char *name, int &occlusionCulling)
+{
+    if (strcmp(name, "none") == 0) occlusionCulling = Scene::NONE;
+    else if (strcmp(name, "stop-and-wait") == 0) occlusionCulling = Scene::STOP_AND_WAIT;
+    else if (strcmp(name, "advanced") == 0) occlusionCulling = Scene::ADVANCED;
+    else if (strcmp(name, "chc") == 0) occlusionCulling = Scene::CHC;
+    else return false;
+    return true;
+}
+
+bool parseCommandLine(int argc, char **argv, CommandLineOptions &options)
+{
+    options.occlusionCulling = -1;
+    options.gridSize = 0;
+    options.hierarchyType = -1;
+    options.quadtreeLayout = -1;
+    options.frustumCulling = false;
+    options.validationMode = false;
+    options.animate = false;
+    options.pipelined = false;
+    options.meshletCulling = false;
+    options.perfCounters = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(arg, "--replay") == 0 && hasValue) options.replayPath = argv[++i];
+        else if (strcmp(arg, "--fps-output") == 0 && hasValue) options.fpsOutputPath = argv[++i];
+        else if (strcmp(arg, "--stats-output") == 0 && hasValue) options.statsOutputPath = argv[++i];
+        else if (strcmp(arg, "--strategy") == 0 && hasValue) {
+            if (!parseStrategy(argv[++i], options.occlusionCulling)) {
+                std::cerr << "Unknown strategy " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--scene") == 0 && hasValue) options.scenePath = argv[++i];
+        else if (strcmp(arg, "--grid-size") == 0 && hasValue) {
+            options.gridSize = atoi(argv[++i]);
+            if (options.gridSize < 1 || options.gridSize > Scene::MAX_GRID_SIZE) {
+                std::cerr << "Grid size must be between 1 and " << Scene::MAX_GRID_SIZE << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--hierarchy") == 0 && hasValue) {
+            const char *name = argv[++i];
+            if (strcmp(name, "quadtree") == 0) options.hierarchyType = Scene::QUADTREE;
+            else if (strcmp(name, "bvh") == 0) options.hierarchyType = Scene::BVH;
+            else {
+                std::cerr << "Unknown hierarchy " << name << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--quadtree-layout") == 0 && hasValue) {
+            const char *name = argv[++i];
+            if (strcmp(name, "bfs") == 0) options.quadtreeLayout = Quadtree::BREADTH_FIRST;
+            else if (strcmp(name, "dfs") == 0) options.quadtreeLayout = Quadtree::DEPTH_FIRST;
+            else if (strcmp(name, "veb") == 0) options.quadtreeLayout = Quadtree::VAN_EMDE_BOAS;
+            else {
+                std::cerr << "Unknown quadtree layout " << name << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--frustum-culling") == 0) options.frustumCulling = true;
+        else if (strcmp(arg, "--validate") == 0) options.validationMode = true;
+        else if (strcmp(arg, "--animate") == 0) options.animate = true;
+        else if (strcmp(arg, "--pipelined") == 0) options.pipelined = true;
+        else if (strcmp(arg, "--meshlet-culling") == 0) options.meshletCulling = true;
+        else if (strcmp(arg, "--perf-counters") == 0) options.perfCounters = true;
+        else {
+            std::cerr << "Unknown or incomplete option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "  --replay <file>          Replay a recorded path and quit when it ends" << std::endl;
+    std::cerr << "  --fps-output <file>      Where to store the fps along the replay" << std::endl;
+    std::cerr << "  --stats-output <file>    Where to store the per frame statistics along the replay" << std::endl;
+    std::cerr << "  --strategy <name>        none, stop-and-wait, advanced or chc" << std::endl;
+    std::cerr << "  --scene <file>           Load the objects from a scene file instead of the grid" << std::endl;
+    std::cerr << "  --grid-size <n>          Place n x n objects (16 by default, up to " << Scene::MAX_GRID_SIZE << ")" << std::endl;
+    std::cerr << "  --hierarchy <name>       quadtree or bvh, used by chc and frustum culling" << std::endl;
+    std::cerr << "  --quadtree-layout <name> bfs, dfs or veb, order of the quadtree nodes in memory" << std::endl;
+    std::cerr << "  --frustum-culling        Enable frustum culling" << std::endl;
+    std::cerr << "  --validate               Compare every frame against the exact visible set" << std::endl;
+    std::cerr << "  --animate                Move some of the objects every frame" << std::endl;
+    std::cerr << "  --pipelined              Prepare the next frame while the current one is submitted" << std::endl;
+    std::cerr << "  --meshlet-culling        Cull the meshlets of the drawn objects (frustum and facing)" << std::endl;
+    std::cerr << "  --perf-counters          Hardware counters per phase of every frame (Linux)" << std::endl;
+}
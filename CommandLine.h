@@ -0,0 +1,29 @@
+#ifndef _COMMAND_LINE_INCLUDE
+#define _COMMAND_LINE_INCLUDE
+
+#include <string>
+
+// Options to run the application unattended (batch benchmark runs)
+// When a replay path is given the replay starts right away and the application quits when it ends
+struct CommandLineOptions
+{
+    std::string replayPath;
+    std::string fpsOutputPath;
+    std::string statsOutputPath;
+    std::string scenePath;
+    int occlusionCulling;      // -1 keeps the default strategy
+    int gridSize;              // 0 keeps the default size
+    int hierarchyType;         // -1 keeps the default hierarchy
+    int quadtreeLayout;        // -1 keeps the default layout
+    bool frustumCulling;
+    bool validationMode;
+    bool animate;
+    bool pipelined;
+    bool meshletCulling;
+    bool perfCounters;
+};
+
+bool parseCommandLine(int argc, char **argv, CommandLineOptions &options);
+void printUsage(const char *program);
+
+#endif // _COMMAND_LINE_INCLUDE
@@ -0,0 +1,31 @@
+#include "Culling.h"
+
+// Simple conservative frustum culling implementation, all computations are made in world space
+// Checks for the existence of a frustum plane that leaves all vertices of the bounding box on the outside
+// Might return false positives
+bool insideFrustum(const Frustum &frustum, const AABB &aabb)
+{
+    glm::vec4 aabbMin = glm::vec4(aabb.min, 1.0f);
+    glm::vec4 aabbIncrement = glm::vec4(aabb.max - aabb.min, 0.0f);
+
+    for (const glm::vec4 &frustumPlane : frustum.planes) {
+        bool allOutside = true;
+        for (int x = 0; x <= 1 && allOutside; ++x) {
+            for (int y = 0; y <= 1 && allOutside; ++y) {
+                for (int z = 0; z <= 1 && allOutside; ++z) {
+                    glm::vec4 aabbCorner = aabbMin + glm::vec4(x, y, z, 1.0f) * aabbIncrement;
+                    if (glm::dot(frustumPlane, aabbCorner) <= 0.0f) allOutside = false;
+                }
+            }
+        }
+        if (allOutside) return false;
+    }
+    return true;
+}
+
+// Same test for a bounding box (in object space) of an object placed with a translation
+bool insideFrustum(const Frustum &frustum, const AABB &aabb, const glm::vec3 &translation)
+{
+    AABB worldAABB = {aabb.min + translation, aabb.max + translation};
+    return insideFrustum(frustum, worldAABB);
+}
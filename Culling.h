@@ -0,0 +1,13 @@
+#ifndef _CULLING_INCLUDE
+#define _CULLING_INCLUDE
+
+#include "AABB.h"
+#include "Camera.h"
+
+#include <glm/glm.hpp>
+
+// Frustum culling kernels, they only depend on the frustum planes (world space)
+bool insideFrustum(const Frustum &frustum, const AABB &aabb);
+bool insideFrustum(const Frustum &frustum, const AABB &aabb, const glm::vec3 &translation);
+
+#endif // _CULLING_INCLUDE
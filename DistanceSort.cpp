@@ -0,0 +1,101 @@
+#include "DistanceSort.h"
+
+#include <algorithm>
+
+void sortFrontToBack(DistanceObject *first, DistanceObject *last)
+{
+    auto compareFunction = [](const DistanceObject &x, const DistanceObject &y) {return x.first < y.first; };
+    std::sort(first, last, compareFunction);
+}
+
+void sortFrontToBack(std::vector<DistanceObject> &objects)
+{
+    sortFrontToBack(objects.data(), objects.data() + objects.size());
+}
+
+
+static const int APPROXIMATE_BITS = 10;
+
+// Below this size the comparison sort is as fast and exact
+static const std::size_t MIN_LINEAR_SORT = 256;
+
+DistanceSorter::DistanceSorter()
+    : mode(RADIX)
+{
+
+}
+
+void DistanceSorter::reserve(std::size_t count)
+{
+    keys.reserve(count);
+    bufferKeys.reserve(count);
+    buffer.reserve(count);
+}
+
+void DistanceSorter::sort(DistanceObject *first, DistanceObject *last)
+{
+    std::size_t count = last - first;
+    if (mode == COMPARISON || count < MIN_LINEAR_SORT) {
+        sortFrontToBack(first, last);
+        return;
+    }
+
+    float minDistance = first->first;
+    float maxDistance = first->first;
+    for (const DistanceObject *object = first; object != last; ++object) {
+        minDistance = std::min(minDistance, object->first);
+        maxDistance = std::max(maxDistance, object->first);
+    }
+    if (maxDistance <= minDistance) return; // All at the same distance
+
+    keys.resize(count);
+    bufferKeys.resize(count);
+    buffer.resize(count);
+    int bits = (mode == RADIX) ? 16 : APPROXIMATE_BITS;
+    float scale = ((1 << bits) - 1) / (maxDistance - minDistance);
+    if (mode == RADIX) radixSort(first, count, minDistance, scale);
+    else bucketSort(first, count, minDistance, scale);
+}
+
+// Least significant byte first, both histograms are computed in the same pass
+void DistanceSorter::radixSort(DistanceObject *first, std::size_t count, float minDistance, float scale)
+{
+    std::size_t low[257] = {0};
+    std::size_t high[257] = {0};
+    for (std::size_t i = 0; i < count; ++i) {
+        uint16_t key = static_cast<uint16_t>((first[i].first - minDistance) * scale);
+        keys[i] = key;
+        ++low[(key & 0xFF) + 1];
+        ++high[(key >> 8) + 1];
+    }
+    for (int b = 0; b < 256; ++b) {
+        low[b + 1] += low[b];
+        high[b + 1] += high[b];
+    }
+
+    // Objects and keys go to the buffers by the low byte and come back by the high byte
+    for (std::size_t i = 0; i < count; ++i) {
+        std::size_t j = low[keys[i] & 0xFF]++;
+        buffer[j] = first[i];
+        bufferKeys[j] = keys[i];
+    }
+    for (std::size_t i = 0; i < count; ++i)
+        first[high[bufferKeys[i] >> 8]++] = buffer[i];
+}
+
+void DistanceSorter::bucketSort(DistanceObject *first, std::size_t count, float minDistance, float scale)
+{
+    const int numBuckets = 1 << APPROXIMATE_BITS;
+    std::size_t offsets[numBuckets + 1] = {0};
+    for (std::size_t i = 0; i < count; ++i) {
+        uint16_t key = static_cast<uint16_t>((first[i].first - minDistance) * scale);
+        keys[i] = key;
+        ++offsets[key + 1];
+    }
+    for (int b = 0; b < numBuckets; ++b)
+        offsets[b + 1] += offsets[b];
+
+    for (std::size_t i = 0; i < count; ++i)
+        buffer[offsets[keys[i]]++] = first[i];
+    std::copy(buffer.begin(), buffer.begin() + count, first);
+}
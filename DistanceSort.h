@@ -0,0 +1,49 @@
+#ifndef _DISTANCE_SORT_INCLUDE
+#define _DISTANCE_SORT_INCLUDE
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Object (id) and its distance to the camera
+using DistanceObject = std::pair<float,int>;
+
+// Front to back ordering of the objects
+void sortFrontToBack(DistanceObject *first, DistanceObject *last);
+void sortFrontToBack(std::vector<DistanceObject> &objects);
+
+// Front to back ordering for many objects placed anywhere
+// The distances (or depths along the view direction) are quantized to integer keys over their range
+// and the objects are sorted by the keys in linear time, the buffers are kept between calls
+class DistanceSorter
+{
+
+public:
+    enum Mode
+    {
+        COMPARISON,     // std::sort, exact
+        RADIX,          // 16 bit keys, two 8 bit passes
+        APPROXIMATE     // 1024 buckets, a single pass, objects within a bucket keep their order
+    };
+
+    DistanceSorter();
+
+    void setMode(Mode mode) {this->mode = mode;}
+    Mode getMode() const {return mode;}
+    void reserve(std::size_t count);
+
+    void sort(DistanceObject *first, DistanceObject *last);
+    void sort(std::vector<DistanceObject> &objects) {sort(objects.data(), objects.data() + objects.size());}
+
+private:
+    void radixSort(DistanceObject *first, std::size_t count, float minDistance, float scale);
+    void bucketSort(DistanceObject *first, std::size_t count, float minDistance, float scale);
+
+private:
+    Mode mode;
+    std::vector<uint16_t> keys;
+    std::vector<uint16_t> bufferKeys;
+    std::vector<DistanceObject> buffer;
+};
+
+#endif // _DISTANCE_SORT_INCLUDE
@@ -0,0 +1,45 @@
+#include "FrameArena.h"
+
+FrameArena::FrameArena(std::size_t capacity)
+    : buffer(capacity)
+    , offset(0)
+    , used(0)
+{
+
+}
+
+FrameArena::~FrameArena()
+{
+    freeOverflow();
+}
+
+void *FrameArena::allocate(std::size_t bytes, std::size_t alignment)
+{
+    std::size_t start = (offset + alignment - 1) & ~(alignment - 1);
+    used += bytes + (start - offset);
+    if (start + bytes <= buffer.size()) {
+        offset = start + bytes;
+        return buffer.data() + start;
+    }
+
+    // Does not fit, serve it from the heap until the arena grows
+    void *p = ::operator new(bytes);
+    overflow.push_back(p);
+    return p;
+}
+
+void FrameArena::reset()
+{
+    if (!overflow.empty()) {
+        freeOverflow();
+        buffer = std::vector<unsigned char>(2 * used);
+    }
+    offset = 0;
+    used = 0;
+}
+
+void FrameArena::freeOverflow()
+{
+    for (void *p : overflow) ::operator delete(p);
+    overflow.clear();
+}
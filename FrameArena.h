@@ -0,0 +1,112 @@
+#ifndef _FRAME_ARENA_INCLUDE
+#define _FRAME_ARENA_INCLUDE
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Linear allocator for the memory of a frame
+// Allocating only bumps an offset, nothing is freed until reset (at the beginning of the frame)
+// Requests that do not fit go to the heap and the arena grows to the high water mark on the next reset,
+// so in steady state a frame makes no heap allocations
+class FrameArena
+{
+
+public:
+    explicit FrameArena(std::size_t capacity = 1 << 20);
+    ~FrameArena();
+
+    void *allocate(std::size_t bytes, std::size_t alignment);
+    void reset();
+
+    std::size_t getCapacity() const {return buffer.size();}
+    std::size_t getUsed() const {return used;}
+
+private:
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void freeOverflow();
+
+private:
+    std::vector<unsigned char> buffer;
+    std::size_t offset;
+    std::size_t used;                  // Including the requests that overflowed
+    std::vector<void *> overflow;
+};
+
+
+// Standard allocator over a FrameArena, deallocation does nothing
+// Without an arena it falls back to the heap (default constructed containers)
+template <typename T>
+class ArenaAllocator
+{
+
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator() : arena(nullptr) {}
+    explicit ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.getArena()) {}
+
+    T *allocate(std::size_t n)
+    {
+        if (!arena) return static_cast<T *>(::operator new(n * sizeof(T)));
+        return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t)
+    {
+        if (!arena) ::operator delete(p);
+    }
+
+    FrameArena *getArena() const {return arena;}
+
+private:
+    FrameArena *arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+    return a.getArena() == b.getArena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+    return !(a == b);
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+
+// FIFO queue over an arena vector, popped elements are only reclaimed when the arena is reset
+// (std::deque allocates a block map even when it is empty)
+template <typename T>
+class ArenaQueue
+{
+
+public:
+    explicit ArenaQueue(FrameArena &arena) : elements(ArenaAllocator<T>(arena)), head(0) {}
+
+    void reserve(std::size_t n) {elements.reserve(n);}
+    bool empty() const {return head == elements.size();}
+    const T &front() const {return elements[head];}
+    void pop() {++head;}
+    template <typename... Args>
+    void emplace(Args &&...args) {elements.emplace_back(std::forward<Args>(args)...);}
+
+private:
+    ArenaVector<T> elements;
+    std::size_t head;
+};
+
+#endif // _FRAME_ARENA_INCLUDE
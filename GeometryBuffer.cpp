@@ -0,0 +1,140 @@
+#include "GeometryBuffer.h"
+
+#include <algorithm>
+#include <iterator>
+
+GeometryBuffer::GeometryBuffer()
+    : posLocation(-1)
+    , normalLocation(-1)
+    , colorLocation(-1)
+    , boundFormat(-1)
+{
+    for (int i = 0; i < NUM_FORMATS; ++i) {
+        formats[i].vertexSize = (i == 1) ? 10 : 6;
+        formats[i].vao = 0;
+        formats[i].vbo = 0;
+        formats[i].capacity = 0;
+    }
+}
+
+GeometryBuffer::~GeometryBuffer()
+{
+    for (Format &format : formats) {
+        if (format.vbo) glDeleteBuffers(1, &format.vbo);
+        if (format.vao) glDeleteVertexArrays(1, &format.vao);
+    }
+}
+
+void GeometryBuffer::init(ShaderProgram &program)
+{
+    posLocation = program.getAttributeLocation("mPos");
+    normalLocation = program.getAttributeLocation("mNormal");
+    colorLocation = program.getAttributeLocation("mColor");
+}
+
+int GeometryBuffer::allocate(int vertexSize, int numVertices, const float *data)
+{
+    Format &format = formats[formatIndex(vertexSize)];
+    if (numVertices <= 0) return 0;
+
+    auto range = std::find_if(format.freeRanges.begin(), format.freeRanges.end(),
+                              [numVertices](const std::pair<const int, int> &free) {return free.second >= numVertices;});
+    if (range == format.freeRanges.end()) {
+        createBuffer(format, std::max({2 * format.capacity, format.capacity + numVertices, INITIAL_VERTICES}));
+        range = std::find_if(format.freeRanges.begin(), format.freeRanges.end(),
+                             [numVertices](const std::pair<const int, int> &free) {return free.second >= numVertices;});
+    }
+
+    int firstVertex = range->first;
+    int remaining = range->second - numVertices;
+    format.freeRanges.erase(range);
+    if (remaining > 0) format.freeRanges[firstVertex + numVertices] = remaining;
+
+    if (data) {
+        GLsizeiptr vertexBytes = format.vertexSize * sizeof(float);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, format.vbo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, firstVertex * vertexBytes, numVertices * vertexBytes, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    return firstVertex;
+}
+
+void GeometryBuffer::free(int vertexSize, int firstVertex, int numVertices)
+{
+    if (numVertices <= 0) return;
+    addFreeRange(formats[formatIndex(vertexSize)], firstVertex, numVertices);
+}
+
+// Merged with the free ranges next to it
+void GeometryBuffer::addFreeRange(Format &format, int firstVertex, int numVertices)
+{
+    std::map<int, int> &ranges = format.freeRanges;
+    auto next = ranges.lower_bound(firstVertex);
+    if (next != ranges.end() && firstVertex + numVertices == next->first) {
+        numVertices += next->second;
+        next = ranges.erase(next);
+    }
+    if (next != ranges.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == firstVertex) {
+            previous->second += numVertices;
+            return;
+        }
+    }
+    ranges[firstVertex] = numVertices;
+}
+
+// The vertices already in the buffer are copied to the new one on the GPU, the vertex array is pointed at it
+void GeometryBuffer::createBuffer(Format &format, int capacity)
+{
+    GLsizeiptr vertexBytes = format.vertexSize * sizeof(float);
+    GLuint buffer;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity * vertexBytes, nullptr, GL_STATIC_DRAW);
+    if (format.vbo) {
+        glBindBuffer(GL_COPY_READ_BUFFER, format.vbo);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, format.capacity * vertexBytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &format.vbo);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    format.vbo = buffer;
+    addFreeRange(format, format.capacity, capacity - format.capacity);
+    format.capacity = capacity;
+
+    if (!format.vao) glGenVertexArrays(1, &format.vao);
+    glBindVertexArray(format.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, format.vbo);
+    glVertexAttribPointer(posLocation, 3, GL_FLOAT, GL_FALSE, vertexBytes, 0);
+    glEnableVertexAttribArray(posLocation);
+    glVertexAttribPointer(normalLocation, 3, GL_FLOAT, GL_FALSE, vertexBytes, (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(normalLocation);
+    if (format.vertexSize == 10 && colorLocation != -1) {
+        glVertexAttribPointer(colorLocation, 4, GL_FLOAT, GL_FALSE, vertexBytes, (void *)(6 * sizeof(float)));
+        glEnableVertexAttribArray(colorLocation);
+    }
+    glBindVertexArray(0);
+    boundFormat = -1;
+}
+
+void GeometryBuffer::bind(int vertexSize)
+{
+    int index = formatIndex(vertexSize);
+    if (index == boundFormat) return;
+
+    glBindVertexArray(formats[index].vao);
+    // Without an array the color attribute takes its current value, white
+    if (formats[index].vertexSize == 6 && colorLocation != -1)
+        glVertexAttrib4f(colorLocation, 1.0f, 1.0f, 1.0f, 1.0f);
+    boundFormat = index;
+}
+
+std::size_t GeometryBuffer::getCapacityBytes() const
+{
+    std::size_t bytes = 0;
+    for (const Format &format : formats)
+        bytes += static_cast<std::size_t>(format.capacity) * format.vertexSize * sizeof(float);
+    return bytes;
+}
@@ -0,0 +1,69 @@
+#ifndef _GEOMETRY_BUFFER_INCLUDE
+#define _GEOMETRY_BUFFER_INCLUDE
+
+#include "ShaderProgram.h"
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <cstddef>
+#include <map>
+
+// GeometryBuffer holds the vertices of all the static geometry (meshes, proxy cube, floor) in a single vertex
+// buffer and vertex array per vertex format, so drawing any of them only selects its range of vertices (the
+// first vertex of glDrawArrays acts as its base vertex) and consecutive draws of the same format never
+// switch vertex arrays. There are two formats: position and normal, and position, normal and color.
+// The ranges are allocated first fit from a list of free ranges, and a buffer that runs out of room is
+// replaced by one twice as large, copied on the GPU
+class GeometryBuffer
+{
+
+public:
+    static const int INITIAL_VERTICES = 1 << 20;
+
+    GeometryBuffer();
+    ~GeometryBuffer();
+
+    // The attribute locations are those of the program
+    void init(ShaderProgram &program);
+
+    // First vertex of a new range of the format (floats per vertex, 6 or 10), filled with data when given
+    int allocate(int vertexSize, int numVertices, const float *data);
+    void free(int vertexSize, int firstVertex, int numVertices);
+
+    GLuint getBuffer(int vertexSize) const {return formats[formatIndex(vertexSize)].vbo;}
+
+    // Binds the vertex array of the format unless it is bound already
+    void bind(int vertexSize);
+    // Something else (e.g. the UI) may have bound another vertex array since the last bind
+    void resetBinding() {boundFormat = -1;}
+
+    std::size_t getCapacityBytes() const;
+
+private:
+    GeometryBuffer(const GeometryBuffer &) = delete;
+    GeometryBuffer &operator=(const GeometryBuffer &) = delete;
+
+    struct Format
+    {
+        int vertexSize;
+        GLuint vao;
+        GLuint vbo;
+        int capacity;                   // Vertices
+        std::map<int, int> freeRanges;  // First vertex to number of vertices, never adjacent
+    };
+
+    static int formatIndex(int vertexSize) {return vertexSize == 10 ? 1 : 0;}
+    void createBuffer(Format &format, int capacity);
+    void addFreeRange(Format &format, int firstVertex, int numVertices);
+
+private:
+    static const int NUM_FORMATS = 2;
+
+    Format formats[NUM_FORMATS];
+    GLint posLocation, normalLocation, colorLocation;
+    int boundFormat;
+
+};
+
+#endif // _GEOMETRY_BUFFER_INCLUDE
@@ -0,0 +1,17 @@
+#include "Instance.h"
+
+// Transformed center and extents (absolute values of the linear part applied to the half sizes)
+AABB transformAABB(const AABB &aabb, const glm::mat4 &model)
+{
+    glm::vec3 center = glm::vec3(model * glm::vec4((aabb.min + aabb.max) / 2.0f, 1.0f));
+    glm::vec3 halfSize = (aabb.max - aabb.min) / 2.0f;
+
+    glm::vec3 extents(0.0f);
+    for (int column = 0; column < 3; ++column)
+        extents += glm::abs(glm::vec3(model[column])) * halfSize[column];
+
+    AABB transformed;
+    transformed.min = center - extents;
+    transformed.max = center + extents;
+    return transformed;
+}
@@ -0,0 +1,20 @@
+#ifndef _INSTANCE_INCLUDE
+#define _INSTANCE_INCLUDE
+
+#include "AABB.h"
+
+#include <glm/glm.hpp>
+
+// Object of the scene, a mesh of the mesh table placed in the world
+struct Instance
+{
+    int mesh;
+    glm::mat4 model;
+    glm::vec4 color;
+    AABB aabb;          // World space, precomputed from the mesh bounding box
+};
+
+// World space bounding box of a model space one
+AABB transformAABB(const AABB &aabb, const glm::mat4 &model);
+
+#endif // _INSTANCE_INCLUDE
@@ -0,0 +1,122 @@
+#include "JobSystem.h"
+
+// Deque of the current thread, for the system it belongs to
+static thread_local const JobSystem *workerSystem = nullptr;
+static thread_local int workerQueue = -1;
+
+JobSystem::JobSystem(int numWorkers)
+    : owner(std::this_thread::get_id())
+    , queued(0)
+    , stopping(false)
+{
+    if (numWorkers < 0) numWorkers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    externalQueue = numWorkers + 1;
+    for (int i = 0; i <= externalQueue; ++i) queues.emplace_back(new Queue());
+    for (int i = 1; i <= numWorkers; ++i) workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread &worker : workers) worker.join();
+}
+
+int JobSystem::currentQueue() const
+{
+    if (workerSystem == this) return workerQueue;
+    if (std::this_thread::get_id() == owner) return 0;
+    return externalQueue;
+}
+
+void JobSystem::spawn(JobGroup &group, JobFunction function, void *data, int begin, int end)
+{
+    Job job = {function, data, begin, end, &group};
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+    if (!push(currentQueue(), job)) {
+        run(job); // Full deque
+        return;
+    }
+
+    // Taking the lock keeps a worker from missing the job between its check and going to sleep
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wakeUp.notify_one();
+}
+
+void JobSystem::wait(JobGroup &group)
+{
+    int queue = currentQueue();
+    while (group.pending.load(std::memory_order_acquire) > 0) {
+        Job job;
+        if (pop(queue, job) || (queue != 0 && steal(queue, job))) run(job);
+        else std::this_thread::yield();
+    }
+}
+
+bool JobSystem::push(int queue, const Job &job)
+{
+    Queue &q = *queues[queue];
+    {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tail - q.head == QUEUE_CAPACITY) return false;
+        q.jobs[q.tail % QUEUE_CAPACITY] = job;
+        ++q.tail;
+    }
+    ++queued;
+    return true;
+}
+
+bool JobSystem::pop(int queue, Job &job)
+{
+    Queue &q = *queues[queue];
+    {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tail == q.head) return false;
+        --q.tail;
+        job = q.jobs[q.tail % QUEUE_CAPACITY];
+    }
+    --queued;
+    return true;
+}
+
+// Takes the oldest job of the first other deque that has any
+bool JobSystem::steal(int thief, Job &job)
+{
+    int numQueues = queues.size();
+    for (int k = 1; k < numQueues; ++k) {
+        Queue &q = *queues[(thief + k) % numQueues];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tail == q.head) continue;
+        job = q.jobs[q.head % QUEUE_CAPACITY];
+        ++q.head;
+        --queued;
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::run(const Job &job)
+{
+    job.function(job.data, job.begin, job.end);
+    job.group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::workerLoop(int queue)
+{
+    workerSystem = this;
+    workerQueue = queue;
+    while (true) {
+        Job job;
+        if (pop(queue, job) || steal(queue, job)) {
+            run(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this]() {return stopping || queued > 0;});
+        if (stopping) return;
+    }
+}
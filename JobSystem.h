@@ -0,0 +1,131 @@
+#ifndef _JOB_SYSTEM_INCLUDE
+#define _JOB_SYSTEM_INCLUDE
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Function run by a job over a range of indices, data points to the state of whoever spawned it
+using JobFunction = void (*)(void *data, int begin, int end);
+
+// Jobs of a group that have not finished yet, waited on by the thread that spawned them
+struct JobGroup
+{
+    std::atomic<int> pending{0};
+};
+
+struct Job
+{
+    JobFunction function;
+    void *data;
+    int begin;
+    int end;
+    JobGroup *group;
+};
+
+// Fixed pool of worker threads with work stealing
+// Every thread has a deque of jobs: it pushes and pops its own jobs at the back and the idle threads steal
+// from the front of the others. The thread that creates the system (the GL thread) only runs the jobs of its
+// own deque, so it never picks up a long job (e.g. a hierarchy rebuild) spawned by another thread.
+// Threads that are not part of the pool share an extra deque.
+// The deques have a fixed capacity (a job that does not fit runs right away), so spawning and running jobs
+// makes no heap allocations
+class JobSystem
+{
+
+public:
+    static const int QUEUE_CAPACITY = 1024;
+
+    // By default one worker per core besides the calling thread
+    explicit JobSystem(int numWorkers = -1);
+    ~JobSystem();
+
+    // Workers and the calling thread
+    int getNumThreads() const {return workers.size() + 1;}
+
+    void spawn(JobGroup &group, JobFunction function, void *data, int begin, int end);
+
+    // function() must stay alive until the group is waited on
+    template <typename F>
+    void spawn(JobGroup &group, const F &function);
+
+    // Runs jobs until all the jobs of the group have finished
+    void wait(JobGroup &group);
+
+    // Runs function(begin, end) over chunks of at least grain indices of [begin, end) and waits for all of them,
+    // the calling thread takes the first chunk
+    template <typename F>
+    void parallelFor(int begin, int end, int grain, const F &function);
+
+private:
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    struct Queue
+    {
+        std::mutex mutex;
+        Job jobs[QUEUE_CAPACITY];
+        std::size_t head = 0;       // Oldest job, stolen first
+        std::size_t tail = 0;       // One past the newest job, popped first by the owner
+    };
+
+    int currentQueue() const;
+    bool push(int queue, const Job &job);
+    bool pop(int queue, Job &job);
+    bool steal(int thief, Job &job);
+    void run(const Job &job);
+    void workerLoop(int queue);
+
+private:
+    std::vector<std::unique_ptr<Queue>> queues;     // Owner thread, workers and other threads
+    std::vector<std::thread> workers;
+    std::thread::id owner;
+    int externalQueue;
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::atomic<int> queued;        // Jobs waiting in any of the deques
+    bool stopping;
+};
+
+
+template <typename F>
+void JobSystem::spawn(JobGroup &group, const F &function)
+{
+    JobFunction call = [](void *data, int, int) {(*static_cast<const F *>(data))();};
+    spawn(group, call, const_cast<F *>(&function), 0, 0);
+}
+
+
+template <typename F>
+void JobSystem::parallelFor(int begin, int end, int grain, const F &function)
+{
+    int count = end - begin;
+    if (count <= 0) return;
+    int numChunks = std::min((count + grain - 1) / std::max(grain, 1), 4 * getNumThreads());
+    if (numChunks <= 1) {
+        function(begin, end);
+        return;
+    }
+
+    JobFunction call = [](void *data, int first, int last) {(*static_cast<const F *>(data))(first, last);};
+    JobGroup group;
+    int chunk = count / numChunks;
+    int extra = count % numChunks;
+    int firstEnd = begin + chunk + (extra > 0);
+    int first = firstEnd;
+    for (int i = 1; i < numChunks; ++i) {
+        int last = first + chunk + (i < extra);
+        spawn(group, call, const_cast<F *>(&function), first, last);
+        first = last;
+    }
+    function(begin, firstEnd);
+    wait(group);
+}
+
+#endif // _JOB_SYSTEM_INCLUDE
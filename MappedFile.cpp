@@ -0,0 +1,70 @@
+#include "MappedFile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+#include <fstream>
+
+MappedFile::MappedFile()
+    : begin(nullptr)
+    , length(0)
+    , mapped(false)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string &filename)
+{
+    close();
+
+#ifdef HAVE_MMAP
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0) {
+        void *address = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            // The loaders read the file front to back once
+            madvise(address, status.st_size, MADV_SEQUENTIAL);
+            begin = static_cast<const char *>(address);
+            length = status.st_size;
+            mapped = true;
+        }
+    }
+    ::close(fd);
+    if (mapped) return true;
+#endif
+
+    std::ifstream fin(filename.c_str(), std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+    if (!fin.is_open()) return false;
+    buffer.resize(static_cast<std::size_t>(fin.tellg()));
+    fin.seekg(0);
+    if (!fin.read(buffer.data(), buffer.size())) {
+        buffer.clear();
+        return false;
+    }
+    begin = buffer.data();
+    length = buffer.size();
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef HAVE_MMAP
+    if (mapped) munmap(const_cast<char *>(begin), length);
+#endif
+    begin = nullptr;
+    length = 0;
+    mapped = false;
+    buffer.clear();
+    buffer.shrink_to_fit();
+}
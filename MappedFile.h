@@ -0,0 +1,36 @@
+#ifndef _MAPPED_FILE_INCLUDE
+#define _MAPPED_FILE_INCLUDE
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read only view of a whole file
+// Memory mapped where the platform supports it, so the loaders parse the page cache in place,
+// and read into memory otherwise
+class MappedFile
+{
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string &filename);
+    void close();
+
+    const char *data() const {return begin;}
+    std::size_t size() const {return length;}
+
+private:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+private:
+    const char *begin;
+    std::size_t length;
+    bool mapped;
+    std::vector<char> buffer;      // Contents when the file could not be mapped
+
+};
+
+#endif // _MAPPED_FILE_INCLUDE
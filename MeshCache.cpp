@@ -0,0 +1,138 @@
+#include "MeshCache.h"
+
+#include <climits>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+static const char MAGIC[8] = {'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H'};
+
+// The vertex buffer follows the header, which keeps it aligned to 16 bytes, and the meshlets follow the buffer
+struct MeshCacheHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t vertexSize;
+    std::uint64_t sourceHash;
+    std::uint64_t sourceSize;
+    std::int64_t sourceTime;
+    std::uint32_t numVertices;
+    std::uint32_t numMeshlets;
+    std::uint32_t padding[2];
+    float aabbMin[3];
+    float aabbMax[3];
+};
+
+static_assert(sizeof(MeshCacheHeader) % 16 == 0, "The vertex buffer must stay aligned");
+
+bool MeshCache::hashFile(const std::string &filename, std::uint64_t &hash, std::uint64_t &size)
+{
+    MappedFile file;
+    if (!file.open(filename)) return false;
+
+    const std::uint64_t prime = 1099511628211ull;
+    const char *data = file.data();
+    std::size_t words = file.size() / sizeof(std::uint64_t);
+    hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < words; ++i) {
+        std::uint64_t word;
+        memcpy(&word, data + i * sizeof(word), sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    for (std::size_t i = words * sizeof(std::uint64_t); i < file.size(); ++i)
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    size = file.size();
+    return true;
+}
+
+bool MeshCache::fileStamp(const std::string &filename, std::uint64_t &size, std::int64_t &time)
+{
+    std::error_code error;
+    size = std::filesystem::file_size(filename, error);
+    if (error) return false;
+    time = std::filesystem::last_write_time(filename, error).time_since_epoch().count();
+    return !error;
+}
+
+// The source is only hashed when its modification time changed (e.g. touched or copied) but not its size,
+// the cache then takes the new time so that the next start doesn't hash it again
+bool MeshCache::open(const std::string &filename, CachedMesh &cached)
+{
+    if (!cached.file.open(cachePath(filename))) return false;
+
+    MeshCacheHeader header;
+    if (cached.file.size() < sizeof(header)) return false;
+    memcpy(&header, cached.file.data(), sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) return false;
+    if (header.vertexSize != 6 && header.vertexSize != 10) return false;
+    if (header.numVertices > INT_MAX || header.numMeshlets > header.numVertices) return false;
+    std::uint64_t bufferSize = static_cast<std::uint64_t>(header.numVertices) * header.vertexSize * sizeof(float);
+    std::uint64_t meshletsSize = Meshlets::serializedSize(header.numMeshlets);
+    if (cached.file.size() != sizeof(header) + bufferSize + meshletsSize) return false;
+
+    std::uint64_t size;
+    std::int64_t time;
+    if (!fileStamp(filename, size, time) || size != header.sourceSize) return false;
+    if (time != header.sourceTime) {
+        std::uint64_t hash;
+        if (!hashFile(filename, hash, size) || hash != header.sourceHash || size != header.sourceSize) return false;
+        std::fstream fout(cachePath(filename), std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+        fout.seekp(offsetof(MeshCacheHeader, sourceTime));
+        fout.write(reinterpret_cast<const char *>(&time), sizeof(time));
+    }
+
+    const char *meshlets = cached.file.data() + sizeof(header) + bufferSize;
+    if (!cached.meshlets.deserialize(meshlets, header.numMeshlets, header.numVertices)) return false;
+    cached.vertexBuffer = reinterpret_cast<const float *>(cached.file.data() + sizeof(header));
+    cached.numVertices = header.numVertices;
+    cached.vertexSize = header.vertexSize;
+    cached.aabb.min = glm::vec3(header.aabbMin[0], header.aabbMin[1], header.aabbMin[2]);
+    cached.aabb.max = glm::vec3(header.aabbMax[0], header.aabbMax[1], header.aabbMax[2]);
+    return true;
+}
+
+// Written to a temporary file renamed over the cache, so a cache is never read half written
+bool MeshCache::store(const std::string &filename, const TriangleMesh &mesh, const std::vector<float> &vertexBuffer,
+                      const Meshlets &meshlets)
+{
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.vertexSize = mesh.getVertexSize();
+    header.numVertices = 3 * mesh.getNumTriangles();
+    header.numMeshlets = meshlets.size();
+    for (int i = 0; i < 3; ++i) {
+        header.aabbMin[i] = mesh.aabb.min[i];
+        header.aabbMax[i] = mesh.aabb.max[i];
+    }
+    if (vertexBuffer.size() != static_cast<std::size_t>(header.numVertices) * header.vertexSize) return false;
+    std::uint64_t size;
+    if (!fileStamp(filename, size, header.sourceTime)) return false;
+    if (!hashFile(filename, header.sourceHash, header.sourceSize) || size != header.sourceSize) return false;
+
+    std::vector<char> meshletData(Meshlets::serializedSize(meshlets.size()));
+    meshlets.serialize(meshletData.data());
+
+    std::string path = cachePath(filename);
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream fout(temporaryPath, std::ios_base::binary | std::ios_base::trunc);
+        if (!fout.is_open()) return false;
+        fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        fout.write(reinterpret_cast<const char *>(vertexBuffer.data()), vertexBuffer.size() * sizeof(float));
+        fout.write(meshletData.data(), meshletData.size());
+        if (!fout) {
+            fout.close();
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef _MESH_CACHE_INCLUDE
+#define _MESH_CACHE_INCLUDE
+
+#include "AABB.h"
+#include "MappedFile.h"
+#include "TriangleMesh.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Mesh of an up to date cache file, the vertex buffer points into the mapping
+struct CachedMesh
+{
+    MappedFile file;
+    const float *vertexBuffer;
+    int numVertices;
+    int vertexSize;         // Floats per vertex
+    AABB aabb;
+    Meshlets meshlets;
+};
+
+// Binary cache of the meshes as they are sent to OpenGL (the interleaved vertex buffer, its meshlets and the
+// bounds of the rescaled mesh), stored next to their source file as <source>.cache
+// A cache is used while it has the current format version and the size and modification time of the source
+// file it was built from (or, when only the time changed, the hash of its contents), so a warm start maps the
+// cache and uploads its vertex buffer without parsing nor reading the source nor building the meshlets
+class MeshCache
+{
+
+public:
+    static const std::uint32_t VERSION = 4;      // 2: triangles sorted into meshlets, 3: source time, 4: meshlets
+
+    static std::string cachePath(const std::string &filename) {return filename + ".cache";}
+
+    static bool open(const std::string &filename, CachedMesh &cached);
+    static bool store(const std::string &filename, const TriangleMesh &mesh, const std::vector<float> &vertexBuffer,
+                      const Meshlets &meshlets);
+
+    // FNV-1a over the words of the file contents
+    static bool hashFile(const std::string &filename, std::uint64_t &hash, std::uint64_t &size);
+    static bool fileStamp(const std::string &filename, std::uint64_t &size, std::int64_t &time);
+
+};
+
+#endif // _MESH_CACHE_INCLUDE
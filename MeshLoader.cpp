@@ -0,0 +1,236 @@
+#include "MeshLoader.h"
+#include "PLYReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+MeshLoader::MeshLoader()
+    : jobs(nullptr)
+    , decoding(nullptr)
+    , decodingCanceled(false)
+    , stopping(false)
+    , uploadOffset(0)
+    , stagingBuffer(0)
+    , staging(nullptr)
+    , nextRegion(0)
+{
+    for (GLsync &fence : fences) fence = nullptr;
+}
+
+MeshLoader::~MeshLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    if (loader.joinable()) loader.join();
+
+    for (GLsync fence : fences)
+        if (fence) glDeleteSync(fence);
+    if (stagingBuffer) glDeleteBuffers(1, &stagingBuffer);
+}
+
+void MeshLoader::init(JobSystem *jobSystem)
+{
+    jobs = jobSystem;
+    if (!loader.joinable()) loader = std::thread(&MeshLoader::loaderLoop, this);
+}
+
+void MeshLoader::initOpenGL()
+{
+    if (stagingBuffer || !GLEW_ARB_buffer_storage) return;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr size = static_cast<GLsizeiptr>(NUM_STAGING_REGIONS) * STAGING_REGION_SIZE;
+    glGenBuffers(1, &stagingBuffer);
+    glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffer);
+    glBufferStorage(GL_COPY_READ_BUFFER, size, nullptr, flags);
+    staging = static_cast<char *>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, flags));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    if (!staging) {
+        glDeleteBuffers(1, &stagingBuffer);
+        stagingBuffer = 0;
+    }
+}
+
+void MeshLoader::request(const std::string &filename, TriangleMesh *mesh)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back({filename, mesh});
+    }
+    wakeUp.notify_one();
+}
+
+void MeshLoader::cancel(TriangleMesh *mesh)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.erase(std::remove_if(requests.begin(), requests.end(),
+                                      [mesh](const Request &request) {return request.mesh == mesh;}),
+                       requests.end());
+        decoded.erase(std::remove_if(decoded.begin(), decoded.end(),
+                                     [mesh](const std::unique_ptr<LoadedMesh> &result) {return result->mesh == mesh;}),
+                      decoded.end());
+        if (decoding == mesh) decodingCanceled = true;
+    }
+
+    // The parts of the first upload already sent are lost with it
+    if (!uploads.empty() && uploads.front()->mesh == mesh) uploadOffset = 0;
+    uploads.erase(std::remove_if(uploads.begin(), uploads.end(),
+                                 [mesh](const std::unique_ptr<LoadedMesh> &upload) {return upload->mesh == mesh;}),
+                  uploads.end());
+}
+
+bool MeshLoader::isBusy() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return !requests.empty() || decoding || !decoded.empty() || !uploads.empty();
+}
+
+std::size_t MeshLoader::getPendingMemory() const
+{
+    std::size_t bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::unique_ptr<LoadedMesh> &result : decoded) bytes += result->vertexBuffer.capacity() * sizeof(float);
+    }
+    for (const std::unique_ptr<LoadedMesh> &upload : uploads) bytes += upload->vertexBuffer.capacity() * sizeof(float);
+    return bytes;
+}
+
+void MeshLoader::update(GeometryBuffer &geometry, std::vector<TriangleMesh *> &loaded)
+{
+    std::deque<std::unique_ptr<LoadedMesh>> results;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(results, decoded);
+    }
+
+    for (std::unique_ptr<LoadedMesh> &result : results) {
+        if (!result->loaded) {
+            std::cout << "Couldn't load mesh " << result->filename << std::endl;
+            result->mesh->setLoadFailed();
+            loaded.push_back(result->mesh);
+            continue;
+        }
+
+        TriangleMesh &mesh = *result->mesh;
+        const AABB &aabb = result->aabb;
+        std::cout << "Mesh bounding box" << std::endl;
+        std::cout << "min = (" << aabb.min.x << ", " << aabb.min.y << ", " << aabb.min.z << ")" << std::endl;
+        std::cout << "max = (" << aabb.max.x << ", " << aabb.max.y << ", " << aabb.max.z << ")" << std::endl;
+        mesh.aabb = aabb;
+        mesh.setMeshlets(std::move(result->meshlets));
+        mesh.sendToOpenGL(geometry, nullptr, result->numVertices, result->vertexSize);
+        loaded.push_back(&mesh);
+        if (result->numVertices == 0) mesh.setResident();
+        else uploads.push_back(std::move(result));
+    }
+
+    for (int part = 0; part < NUM_STAGING_REGIONS && !uploads.empty(); ++part) {
+        if (!uploadPart()) break;
+    }
+}
+
+// Sends the next part of the first upload, false when the staging region it needs is still in use
+bool MeshLoader::uploadPart()
+{
+    LoadedMesh &upload = *uploads.front();
+    std::size_t size = static_cast<std::size_t>(upload.numVertices) * upload.vertexSize * sizeof(float);
+    std::size_t part = std::min(size - uploadOffset, static_cast<std::size_t>(STAGING_REGION_SIZE));
+    const char *source = reinterpret_cast<const char *>(upload.data) + uploadOffset;
+    // The shared buffer may have been replaced by a larger one since the last part, with the same offsets
+    GLintptr destination = upload.mesh->getBufferOffset() + uploadOffset;
+
+    if (stagingBuffer) {
+        GLsync &fence = fences[nextRegion];
+        if (fence) {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) return false;
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        std::size_t regionOffset = static_cast<std::size_t>(nextRegion) * STAGING_REGION_SIZE;
+        memcpy(staging + regionOffset, source, part);
+        glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, upload.mesh->getVertexBuffer());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, regionOffset, destination, part);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        nextRegion = (nextRegion + 1) % NUM_STAGING_REGIONS;
+    }
+    else {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, upload.mesh->getVertexBuffer());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, destination, part, source);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // The copies are ordered before any later draw, so the mesh can be drawn right away
+    uploadOffset += part;
+    if (uploadOffset == size) {
+        upload.mesh->setResident();
+        uploads.pop_front();
+        uploadOffset = 0;
+    }
+    return true;
+}
+
+void MeshLoader::loaderLoop()
+{
+    while (true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this]() {return stopping || !requests.empty();});
+            if (stopping) return;
+            request = std::move(requests.front());
+            requests.pop_front();
+            decoding = request.mesh;
+            decodingCanceled = false;
+        }
+
+        std::unique_ptr<LoadedMesh> result = load(request);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!decodingCanceled) decoded.push_back(std::move(result));
+        decoding = nullptr;
+    }
+}
+
+// The vertex buffer comes from the cache when it is up to date, otherwise the mesh is parsed, its triangles
+// sorted into meshlets and cached along with the meshlets
+std::unique_ptr<LoadedMesh> MeshLoader::load(const Request &request)
+{
+    std::unique_ptr<LoadedMesh> result(new LoadedMesh());
+    result->filename = request.filename;
+    result->mesh = request.mesh;
+    result->loaded = true;
+    if (MeshCache::open(request.filename, result->cached)) {
+        result->data = result->cached.vertexBuffer;
+        result->numVertices = result->cached.numVertices;
+        result->vertexSize = result->cached.vertexSize;
+        result->aabb = result->cached.aabb;
+        result->meshlets = std::move(result->cached.meshlets);
+        return result;
+    }
+
+    // Never sent to OpenGL, the upload goes through the mesh of the scene
+    TriangleMesh mesh;
+    if (!PLYReader::readMesh(request.filename, mesh, jobs)) {
+        result->loaded = false;
+        return result;
+    }
+    mesh.sortMeshletTriangles();
+    mesh.buildVertexBuffer(result->vertexBuffer);
+    result->data = result->vertexBuffer.data();
+    result->numVertices = 3 * mesh.getNumTriangles();
+    result->vertexSize = mesh.getVertexSize();
+    result->aabb = mesh.aabb;
+    result->meshlets.build(result->data, result->numVertices, result->vertexSize);
+    if (!MeshCache::store(request.filename, mesh, result->vertexBuffer, result->meshlets))
+        std::cout << "Couldn't write the mesh cache " << MeshCache::cachePath(request.filename) << std::endl;
+    return result;
+}
@@ -0,0 +1,108 @@
+#ifndef _MESH_LOADER_INCLUDE
+#define _MESH_LOADER_INCLUDE
+
+#include "AABB.h"
+#include "GeometryBuffer.h"
+#include "JobSystem.h"
+#include "MeshCache.h"
+#include "Meshlets.h"
+#include "TriangleMesh.h"
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Vertex buffer of a mesh decoded by the loader thread, waiting to be uploaded
+struct LoadedMesh
+{
+    std::string filename;
+    TriangleMesh *mesh;
+    bool loaded;                        // False when the file could not be read
+    CachedMesh cached;                  // The vertex buffer points either into a cache file...
+    std::vector<float> vertexBuffer;    // ...or here, when the mesh had to be parsed
+    const float *data;
+    int numVertices;
+    int vertexSize;                     // Floats per vertex
+    AABB aabb;
+    Meshlets meshlets;
+};
+
+// MeshLoader reads the meshes in a thread of its own, so the frames go on while they load, and streams their
+// vertex buffers to OpenGL over the next frames through a persistently mapped staging buffer
+// The staging buffer is a ring of regions: every frame the GL thread copies the next part of a vertex buffer
+// into each region whose previous copy has finished (checked with a fence, never waited on) and asks the
+// GPU to copy it into the buffer of the mesh. A mesh is resident once all its parts have been copied.
+// Without ARB_buffer_storage the parts are sent with glBufferSubData, as much per frame
+class MeshLoader
+{
+
+public:
+    static const int NUM_STAGING_REGIONS = 4;
+    static const int STAGING_REGION_SIZE = 4 << 20;    // Bytes
+
+    MeshLoader();
+    ~MeshLoader();
+
+    // Starts the loader thread, the meshes are decoded with the jobs of the system
+    void init(JobSystem *jobs);
+    void initOpenGL();
+
+    // Queues the mesh to be read from the file, it stays non resident until its upload ends
+    void request(const std::string &filename, TriangleMesh *mesh);
+
+    // Drops anything left to do for the mesh, before it is destroyed
+    void cancel(TriangleMesh *mesh);
+
+    // GL thread, every frame: allocates the vertices of the meshes decoded since the last call in the geometry
+    // buffer, appends them to loaded with their bounds already set (and those that failed, marked as such), and
+    // streams the next parts of the pending uploads
+    void update(GeometryBuffer &geometry, std::vector<TriangleMesh *> &loaded);
+
+    bool isBusy() const;
+
+    // Vertex buffers decoded and not uploaded yet, read into memory (the cache files are mapped)
+    std::size_t getPendingMemory() const;
+
+private:
+    MeshLoader(const MeshLoader &) = delete;
+    MeshLoader &operator=(const MeshLoader &) = delete;
+
+    struct Request
+    {
+        std::string filename;
+        TriangleMesh *mesh;
+    };
+
+    void loaderLoop();
+    std::unique_ptr<LoadedMesh> load(const Request &request);
+    bool uploadPart();
+
+private:
+    JobSystem *jobs;
+    std::thread loader;
+    mutable std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<Request> requests;
+    std::deque<std::unique_ptr<LoadedMesh>> decoded;
+    TriangleMesh *decoding;         // Mesh the loader thread is reading, if any
+    bool decodingCanceled;
+    bool stopping;
+
+    // GL thread only
+    std::deque<std::unique_ptr<LoadedMesh>> uploads;
+    std::size_t uploadOffset;       // Bytes of the first upload already sent
+    GLuint stagingBuffer;           // 0 without ARB_buffer_storage
+    char *staging;
+    GLsync fences[NUM_STAGING_REGIONS];
+    int nextRegion;
+
+};
+
+#endif // _MESH_LOADER_INCLUDE
@@ -0,0 +1,71 @@
+#include "MeshManager.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+void MeshManager::init(JobSystem *jobs)
+{
+    loader.init(jobs);
+    loader.initOpenGL();
+}
+
+std::shared_ptr<TriangleMesh> MeshManager::acquire(const std::string &filename)
+{
+    std::error_code error;
+    std::string key = std::filesystem::weakly_canonical(filename, error).string();
+    if (error) key = filename;
+
+    failures.erase(std::remove(failures.begin(), failures.end(), key), failures.end());
+    std::shared_ptr<TriangleMesh> mesh = meshes[key].lock();
+    if (mesh && !mesh->hasLoadFailed()) return mesh;
+
+    if (!std::ifstream(filename)) {
+        meshes.erase(key);
+        std::cout << "Couldn't load mesh " << filename << std::endl;
+        return nullptr;
+    }
+
+    // Until it is loaded its bounds are those that the reader rescales every mesh into, the unit cube around
+    // the origin
+    mesh.reset(new TriangleMesh(), [this, key](TriangleMesh *mesh) {release(key, mesh);});
+    mesh->aabb.min = glm::vec3(-0.5f);
+    mesh->aabb.max = glm::vec3(0.5f);
+    meshes[key] = mesh;
+    loader.request(filename, mesh.get());
+    return mesh;
+}
+
+void MeshManager::update(GeometryBuffer &geometry, std::vector<TriangleMesh *> &loaded)
+{
+    loader.update(geometry, loaded);
+    for (TriangleMesh *mesh : loaded) {
+        if (!mesh->hasLoadFailed()) continue;
+        auto entry = std::find_if(meshes.begin(), meshes.end(), [mesh](const auto &entry) {return entry.second.lock().get() == mesh;});
+        if (entry == meshes.end()) continue;
+        failures.push_back(entry->first);
+        meshes.erase(entry);
+    }
+}
+
+void MeshManager::release(const std::string &key, TriangleMesh *mesh)
+{
+    loader.cancel(mesh);
+    auto entry = meshes.find(key);
+    if (entry != meshes.end() && entry->second.expired()) meshes.erase(entry);
+    delete mesh;
+}
+
+MeshMemory MeshManager::getMemory() const
+{
+    MeshMemory memory = {0, loader.getPendingMemory(), 0};
+    for (const auto &entry : meshes) {
+        std::shared_ptr<TriangleMesh> mesh = entry.second.lock();
+        if (!mesh) continue;
+        ++memory.meshes;
+        memory.cpuBytes += mesh->getCPUMemory();
+        memory.gpuBytes += mesh->getGPUMemory();
+    }
+    return memory;
+}
@@ -0,0 +1,62 @@
+#ifndef _MESH_MANAGER_INCLUDE
+#define _MESH_MANAGER_INCLUDE
+
+#include "GeometryBuffer.h"
+#include "JobSystem.h"
+#include "MeshLoader.h"
+#include "TriangleMesh.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Memory held by the meshes of the manager
+struct MeshMemory
+{
+    int meshes;
+    std::size_t cpuBytes;       // Arrays kept by the meshes (bounds, meshlets) and vertex buffers waiting to be uploaded
+    std::size_t gpuBytes;       // Their ranges of the geometry buffer
+};
+
+// MeshManager owns the meshes read from files, one per path however many scenes or tables use it
+// A mesh is shared through reference counting and destroyed, freeing its range of the geometry buffer, when its
+// last user lets it go; anything still pending for it in the loader is dropped then. The meshes are read in the
+// background by the loader and keep no CPU copy of their geometry once uploaded, only what the culling needs.
+// The meshes must be released before the manager is destroyed, their deleters use it
+class MeshManager
+{
+
+public:
+    MeshManager() = default;
+
+    void init(JobSystem *jobs);
+
+    // The mesh of the file, queued to be loaded the first time. Null when the file can't be read
+    std::shared_ptr<TriangleMesh> acquire(const std::string &filename);
+
+    // GL thread, every frame, see MeshLoader::update
+    // A mesh that fails to load is forgotten, so acquiring its file again retries while its users keep the failed one
+    void update(GeometryBuffer &geometry, std::vector<TriangleMesh *> &loaded);
+    bool isLoading() const {return loader.isBusy();}
+
+    // Paths of the files that failed to load and weren't acquired again since
+    const std::vector<std::string> &getFailures() const {return failures;}
+
+    MeshMemory getMemory() const;
+
+private:
+    MeshManager(const MeshManager &) = delete;
+    MeshManager &operator=(const MeshManager &) = delete;
+
+    void release(const std::string &key, TriangleMesh *mesh);
+
+private:
+    MeshLoader loader;
+    std::unordered_map<std::string, std::weak_ptr<TriangleMesh>> meshes;      // By canonical path
+    std::vector<std::string> failures;
+
+};
+
+#endif // _MESH_MANAGER_INCLUDE
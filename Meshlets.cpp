@@ -0,0 +1,276 @@
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+// Bits per axis of the Morton code of the triangle centroids
+static const int MORTON_BITS = 10;
+
+static std::uint32_t mortonCode(const glm::uvec3 &cell)
+{
+    std::uint32_t code = 0;
+    for (int bit = 0; bit < MORTON_BITS; ++bit) {
+        code |= ((cell.x >> bit) & 1) << (3 * bit);
+        code |= ((cell.y >> bit) & 1) << (3 * bit + 1);
+        code |= ((cell.z >> bit) & 1) << (3 * bit + 2);
+    }
+    return code;
+}
+
+
+Meshlets::Meshlets()
+    : numMeshlets(0)
+{
+
+}
+
+
+// Axis and sign of the largest component of the face normal, a sixth of the directions
+int Meshlets::normalBucket(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2)
+{
+    glm::vec3 normal = glm::cross(v1 - v0, v2 - v0);
+    glm::vec3 size = glm::abs(normal);
+    int axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+    return 2 * axis + (normal[axis] < 0.0f);
+}
+
+
+void Meshlets::sortTriangles(const std::vector<glm::vec3> &vertices, std::vector<int> &triangles)
+{
+    int numTriangles = triangles.size() / 3;
+    glm::vec3 low(std::numeric_limits<float>::max());
+    glm::vec3 high(-std::numeric_limits<float>::max());
+    for (const glm::vec3 &vertex : vertices) {
+        low = glm::min(low, vertex);
+        high = glm::max(high, vertex);
+    }
+    glm::vec3 scale = float((1 << MORTON_BITS) - 1) / glm::max(high - low, glm::vec3(1e-20f));
+
+    std::vector<std::pair<std::uint64_t, int>> keys(numTriangles);
+    for (int t = 0; t < numTriangles; ++t) {
+        const glm::vec3 &v0 = vertices[triangles[3 * t]];
+        const glm::vec3 &v1 = vertices[triangles[3 * t + 1]];
+        const glm::vec3 &v2 = vertices[triangles[3 * t + 2]];
+        glm::uvec3 cell = glm::uvec3(((v0 + v1 + v2) / 3.0f - low) * scale);
+        std::uint64_t bucket = normalBucket(v0, v1, v2);
+        keys[t] = std::make_pair((bucket << 32) | mortonCode(cell), t);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<int> sorted(triangles.size());
+    for (int t = 0; t < numTriangles; ++t)
+        std::copy_n(&triangles[3 * keys[t].second], 3, &sorted[3 * t]);
+    triangles = std::move(sorted);
+}
+
+
+std::size_t Meshlets::getMemory() const
+{
+    std::size_t bytes = firstVertex.capacity() * sizeof(int);
+    for (const std::vector<float> *field : {&centerX, &centerY, &centerZ, &radius, &axisX, &axisY, &axisZ, &cutoff})
+        bytes += field->capacity() * sizeof(float);
+    return bytes;
+}
+
+
+// A meshlet ends after MAX_TRIANGLES or where the normal bucket changes
+void Meshlets::build(const float *vertexBuffer, int numVertices, int vertexSize)
+{
+    numMeshlets = 0;
+    firstVertex.clear();
+    for (std::vector<float> *field : {&centerX, &centerY, &centerZ, &radius, &axisX, &axisY, &axisZ, &cutoff})
+        field->clear();
+
+    int numTriangles = numVertices / 3;
+    auto position = [=](int vertex) {return glm::vec3(vertexBuffer[vertex * vertexSize],
+                                                      vertexBuffer[vertex * vertexSize + 1],
+                                                      vertexBuffer[vertex * vertexSize + 2]);};
+    int first = 0;
+    int firstBucket = 0;
+    for (int t = 0; t < numTriangles; ++t) {
+        int bucket = normalBucket(position(3 * t), position(3 * t + 1), position(3 * t + 2));
+        if (t == first) firstBucket = bucket;
+        else if (bucket != firstBucket || t - first == MAX_TRIANGLES) {
+            addMeshlet(vertexBuffer, vertexSize, first, t);
+            first = t;
+            firstBucket = bucket;
+        }
+    }
+    if (first < numTriangles) addMeshlet(vertexBuffer, vertexSize, first, numTriangles);
+    firstVertex.push_back(3 * numTriangles);
+}
+
+
+// firstVertex and then every other field, one array after the other
+std::size_t Meshlets::serializedSize(int count)
+{
+    return (static_cast<std::size_t>(count) + 1) * sizeof(int) + 8 * static_cast<std::size_t>(count) * sizeof(float);
+}
+
+
+void Meshlets::serialize(char *data) const
+{
+    memcpy(data, firstVertex.data(), firstVertex.size() * sizeof(int));
+    data += firstVertex.size() * sizeof(int);
+    for (const std::vector<float> *field : {&centerX, &centerY, &centerZ, &radius, &axisX, &axisY, &axisZ, &cutoff}) {
+        memcpy(data, field->data(), numMeshlets * sizeof(float));
+        data += numMeshlets * sizeof(float);
+    }
+}
+
+
+bool Meshlets::deserialize(const char *data, int count, int numVertices)
+{
+    std::vector<int> ranges(count + 1);
+    memcpy(ranges.data(), data, ranges.size() * sizeof(int));
+    data += ranges.size() * sizeof(int);
+    if (ranges.front() != 0 || ranges.back() != numVertices) return false;
+    for (int i = 0; i < count; ++i)
+        if (ranges[i + 1] <= ranges[i] || ranges[i + 1] - ranges[i] > 3 * MAX_TRIANGLES) return false;
+
+    numMeshlets = count;
+    firstVertex = std::move(ranges);
+    for (std::vector<float> *field : {&centerX, &centerY, &centerZ, &radius, &axisX, &axisY, &axisZ, &cutoff}) {
+        field->resize(count);
+        memcpy(field->data(), data, count * sizeof(float));
+        data += count * sizeof(float);
+    }
+    return true;
+}
+
+
+// The sphere is centered on the bounding box of the triangles and the cone axis is their mean normal.
+// All the faces point away from any viewpoint from which the sphere is seen inside the complement of the cone
+void Meshlets::addMeshlet(const float *vertexBuffer, int vertexSize, int firstTriangle, int lastTriangle)
+{
+    glm::vec3 low(std::numeric_limits<float>::max());
+    glm::vec3 high(-std::numeric_limits<float>::max());
+    glm::vec3 normalSum(0.0f);
+    const float *vertex = vertexBuffer + 3 * firstTriangle * vertexSize;
+    int numVertices = 3 * (lastTriangle - firstTriangle);
+    for (int v = 0; v < numVertices; v += 3) {
+        glm::vec3 p[3];
+        for (int k = 0; k < 3; ++k) {
+            p[k] = glm::vec3(vertex[(v + k) * vertexSize], vertex[(v + k) * vertexSize + 1], vertex[(v + k) * vertexSize + 2]);
+            low = glm::min(low, p[k]);
+            high = glm::max(high, p[k]);
+        }
+        glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        float length = glm::length(normal);
+        if (length > 0.0f) normalSum += normal / length;
+    }
+
+    glm::vec3 center = (low + high) / 2.0f;
+    float maxDistance = 0.0f;
+    float minCosine = 1.0f;
+    float sumLength = glm::length(normalSum);
+    glm::vec3 axis = sumLength > 0.0f ? normalSum / sumLength : glm::vec3(0.0f);
+    for (int v = 0; v < numVertices; v += 3) {
+        glm::vec3 p[3];
+        for (int k = 0; k < 3; ++k) {
+            p[k] = glm::vec3(vertex[(v + k) * vertexSize], vertex[(v + k) * vertexSize + 1], vertex[(v + k) * vertexSize + 2]);
+            maxDistance = std::max(maxDistance, glm::length(p[k] - center));
+        }
+        glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        float length = glm::length(normal);
+        if (length > 0.0f) minCosine = std::min(minCosine, glm::dot(axis, normal / length));
+    }
+
+    firstVertex.push_back(3 * firstTriangle);
+    centerX.push_back(center.x);
+    centerY.push_back(center.y);
+    centerZ.push_back(center.z);
+    radius.push_back(maxDistance);
+    axisX.push_back(axis.x);
+    axisY.push_back(axis.y);
+    axisZ.push_back(axis.z);
+    cutoff.push_back((sumLength > 0.0f && minCosine > 0.0f) ? std::sqrt(1.0f - minCosine * minCosine) : 2.0f);
+    ++numMeshlets;
+}
+
+
+// Emits the ranges of the visible meshlets, adjacent ones merged. The open range is kept in locals, so every
+// range is written once and the output is never read back
+template <typename Emit>
+int Meshlets::mergeRanges(int baseVertex, const unsigned char *visible, int &numTriangles, int &numCulled,
+                          Emit emit) const
+{
+    int numRanges = 0;
+    int rangeFirst = 0, rangeCount = 0;
+    numTriangles = 0;
+    numCulled = 0;
+    for (int i = 0; i < numMeshlets; ++i) {
+        if (!visible[i]) {
+            ++numCulled;
+            continue;
+        }
+        int vertices = firstVertex[i + 1] - firstVertex[i];
+        numTriangles += vertices / 3;
+        if (rangeCount > 0 && rangeFirst + rangeCount == baseVertex + firstVertex[i]) {
+            rangeCount += vertices;
+            continue;
+        }
+        if (rangeCount > 0) emit(numRanges++, rangeFirst, rangeCount);
+        rangeFirst = baseVertex + firstVertex[i];
+        rangeCount = vertices;
+    }
+    if (rangeCount > 0) emit(numRanges++, rangeFirst, rangeCount);
+    return numRanges;
+}
+
+
+int Meshlets::cull(const glm::mat4 &model, const CameraSnapshot &camera, int baseVertex, unsigned char *visible,
+                   GLint *first, GLsizei *count, int &numTriangles, int &numCulled) const
+{
+    testMeshlets(model, camera, visible);
+    return mergeRanges(baseVertex, visible, numTriangles, numCulled, [first, count](int range, int rangeFirst, int rangeCount) {
+        first[range] = rangeFirst;
+        count[range] = rangeCount;
+    });
+}
+
+
+int Meshlets::cull(const glm::mat4 &model, const CameraSnapshot &camera, int baseVertex, unsigned char *visible,
+                   DrawArraysCommand *commands, int &numTriangles, int &numCulled) const
+{
+    testMeshlets(model, camera, visible);
+    return mergeRanges(baseVertex, visible, numTriangles, numCulled, [commands](int range, int rangeFirst, int rangeCount) {
+        commands[range] = {static_cast<GLuint>(rangeCount), 1, static_cast<GLuint>(rangeFirst), 0};
+    });
+}
+
+
+// Both tests run in object space: the frustum planes and the camera are taken there by the model, which keeps
+// which side of a plane or a face a point is on, so they are exact for any affine model
+void Meshlets::testMeshlets(const glm::mat4 &model, const CameraSnapshot &camera, unsigned char *visible) const
+{
+    // The planes point outwards
+    glm::vec4 planes[6];
+    for (int p = 0; p < 6; ++p) {
+        glm::vec4 plane = glm::transpose(model) * camera.frustum.planes[p];
+        planes[p] = plane / glm::length(glm::vec3(plane));
+    }
+    glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(camera.position, 1.0f));
+
+    // Without branches (nor a square root) so that the loop is vectorized:
+    // the cone test dot(d, axis) >= cutoff * |d| + radius is squared once both sides are known positive.
+    // The flags are chars, which may alias anything, so the loop only reads locals
+    const float *cx = centerX.data(), *cy = centerY.data(), *cz = centerZ.data(), *radii = radius.data();
+    const float *ax = axisX.data(), *ay = axisY.data(), *az = axisZ.data(), *cutoffs = cutoff.data();
+    int n = numMeshlets;
+    for (int i = 0; i < n; ++i) {
+        float x = cx[i], y = cy[i], z = cz[i], r = radii[i];
+        int outside = 0;
+        for (int p = 0; p < 6; ++p)
+            outside |= planes[p].x * x + planes[p].y * y + planes[p].z * z + planes[p].w > r;
+        float dx = x - eye.x, dy = y - eye.y, dz = z - eye.z;
+        float margin = dx * ax[i] + dy * ay[i] + dz * az[i] - r;
+        float squaredDistance = dx * dx + dy * dy + dz * dz;
+        int backFacing = (margin >= 0.0f) & (margin * margin >= cutoffs[i] * cutoffs[i] * squaredDistance);
+        visible[i] = !(outside | backFacing);
+    }
+}
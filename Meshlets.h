@@ -0,0 +1,74 @@
+#ifndef _MESHLETS_INCLUDE
+#define _MESHLETS_INCLUDE
+
+#include "Camera.h"
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Draw of a range of vertices, laid out as the commands read by glMultiDrawArraysIndirect
+struct DrawArraysCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+// Meshlets of a mesh: runs of up to MAX_TRIANGLES consecutive triangles of its vertex buffer, each one with a
+// bounding sphere and the cone of its face normals (object space)
+// The triangles are sorted first (sortTriangles) by the axis their normal is closest to and then along a
+// Morton curve, so the meshlets are compact and face a single side. An instance rejects the meshlets outside
+// the frustum and those whose faces all point away from the camera before drawing the rest of its mesh.
+// The fields are stored as separate arrays so the tests run vectorized over all the meshlets
+class Meshlets
+{
+
+public:
+    static const int MAX_TRIANGLES = 64;
+
+    Meshlets();
+
+    static void sortTriangles(const std::vector<glm::vec3> &vertices, std::vector<int> &triangles);
+
+    // Splits a vertex buffer whose triangles were sorted by sortTriangles
+    void build(const float *vertexBuffer, int numVertices, int vertexSize);
+
+    int size() const {return numMeshlets;}
+    std::size_t getMemory() const;
+
+    // The arrays as a block of bytes, as stored by the mesh cache. A block is only read back when its ranges
+    // split exactly numVertices vertices
+    static std::size_t serializedSize(int count);
+    void serialize(char *data) const;
+    bool deserialize(const char *data, int count, int numVertices);
+
+    // Vertex ranges of the meshlets of an instance that may be visible from the camera, adjacent ones merged,
+    // starting at baseVertex (where the mesh is in its vertex buffer), visible holds size() flags and first and
+    // count room for size() ranges. Returns the number of ranges
+    int cull(const glm::mat4 &model, const CameraSnapshot &camera, int baseVertex, unsigned char *visible,
+             GLint *first, GLsizei *count, int &numTriangles, int &numCulled) const;
+    // Same ranges as draw commands, each one written once so that they can go to write combined memory
+    int cull(const glm::mat4 &model, const CameraSnapshot &camera, int baseVertex, unsigned char *visible,
+             DrawArraysCommand *commands, int &numTriangles, int &numCulled) const;
+
+private:
+    static int normalBucket(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2);
+    void addMeshlet(const float *vertexBuffer, int vertexSize, int firstTriangle, int lastTriangle);
+    void testMeshlets(const glm::mat4 &model, const CameraSnapshot &camera, unsigned char *visible) const;
+    template <typename Emit>
+    int mergeRanges(int baseVertex, const unsigned char *visible, int &numTriangles, int &numCulled, Emit emit) const;
+
+private:
+    int numMeshlets;
+    std::vector<int> firstVertex;       // One more than meshlets, the last one ends the buffer
+    std::vector<float> centerX, centerY, centerZ, radius;
+    std::vector<float> axisX, axisY, axisZ;
+    std::vector<float> cutoff;          // Sine of the half angle of the cone, above 1 when it can't be culled
+
+};
+
+#endif // _MESHLETS_INCLUDE
@@ -1,54 +1,310 @@
 #include "PLYReader.h"
+#include "MappedFile.h"
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
-#include <fstream>
 #include <limits>
+#include <sstream>
 #include <string>
 #include <vector>
 
-bool PLYReader::readMesh(const std::string &filename, TriangleMesh &mesh)
+// Reads a binary value at a position of a record
+using FloatDecoder = float (*)(const char *data);
+using IntDecoder = int (*)(const char *data);
+
+static const int TYPE_SIZES[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+// Both spellings of the property types, in the order of PLYType
+static const char *TYPE_NAMES[][2] = {{"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+                                      {"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}};
+
+// Vertex properties read into the mesh: position, normal and color
+static const int NUM_VERTEX_FIELDS = 10;
+static const char *VERTEX_FIELD_NAMES[NUM_VERTEX_FIELDS] = {"x", "y", "z", "nx", "ny", "nz", "red", "green", "blue", "alpha"};
+static const int FIRST_NORMAL_FIELD = 3;
+static const int FIRST_COLOR_FIELD = 6;
+
+static bool hostIsLittleEndian()
 {
-    std::ifstream fin;
-    int nVertices, nFaces;
+    const std::uint16_t one = 1;
+    unsigned char firstByte;
+    memcpy(&firstByte, &one, 1);
+    return firstByte == 1;
+}
 
-    fin.open(filename.c_str(), std::ios_base::in | std::ios_base::binary);
-    if (!fin.is_open())
-        return false;
-    if (!loadHeader(fin, nVertices, nFaces))
+template <typename T, bool swap>
+static T load(const char *data)
+{
+    char bytes[sizeof(T)];
+    memcpy(bytes, data, sizeof(T));
+    if (swap) std::reverse(bytes, bytes + sizeof(T));
+    T value;
+    memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+template <typename T, bool swap>
+static float decodeFloat(const char *data)
+{
+    return static_cast<float>(load<T, swap>(data));
+}
+
+template <typename T, bool swap>
+static int decodeInt(const char *data)
+{
+    return static_cast<int>(load<T, swap>(data));
+}
+
+template <bool swap>
+static FloatDecoder floatDecoder(PLYType type)
+{
+    static const FloatDecoder decoders[] = {decodeFloat<std::int8_t, swap>, decodeFloat<std::uint8_t, swap>,
+                                            decodeFloat<std::int16_t, swap>, decodeFloat<std::uint16_t, swap>,
+                                            decodeFloat<std::int32_t, swap>, decodeFloat<std::uint32_t, swap>,
+                                            decodeFloat<float, swap>, decodeFloat<double, swap>};
+    return decoders[type];
+}
+
+template <bool swap>
+static IntDecoder intDecoder(PLYType type)
+{
+    static const IntDecoder decoders[] = {decodeInt<std::int8_t, swap>, decodeInt<std::uint8_t, swap>,
+                                          decodeInt<std::int16_t, swap>, decodeInt<std::uint16_t, swap>,
+                                          decodeInt<std::int32_t, swap>, decodeInt<std::uint32_t, swap>,
+                                          decodeInt<float, swap>, decodeInt<double, swap>};
+    return decoders[type];
+}
+
+// Values of the file byte order differ from the host ones in the swapped decoders
+static bool swapsBytes(PLYFormat format)
+{
+    return (format == PLY_BINARY_BIG_ENDIAN) == hostIsLittleEndian();
+}
+
+static FloatDecoder floatDecoder(PLYFormat format, PLYType type)
+{
+    return swapsBytes(format) ? floatDecoder<true>(type) : floatDecoder<false>(type);
+}
+
+static IntDecoder intDecoder(PLYFormat format, PLYType type)
+{
+    return swapsBytes(format) ? intDecoder<true>(type) : intDecoder<false>(type);
+}
+
+// The binary blocks are split in chunks of records decoded in parallel, a chunk per job
+static const int RECORDS_PER_CHUNK = 65536;
+
+static int numChunks(JobSystem *jobs, int count)
+{
+    if (jobs == nullptr)
+        return 1;
+    return std::max(1, std::min(count / RECORDS_PER_CHUNK, 4 * jobs->getNumThreads()));
+}
+
+static int chunkBegin(int chunk, int chunks, int count)
+{
+    return static_cast<long long>(count) * chunk / chunks;
+}
+
+// Runs function(firstChunk, lastChunk) over the chunks
+template <typename F>
+static void forEachChunk(JobSystem *jobs, int chunks, const F &function)
+{
+    if (jobs != nullptr && chunks > 1)
+        jobs->parallelFor(0, chunks, 1, function);
+    else
+        function(0, chunks);
+}
+
+// Decodes nFaces faces of nothing but the list of indices, of the usual types, without calls
+// Fails on a face that is not a triangle when only triangles are expected
+template <typename Count, typename Index, bool swap>
+static bool decodeIndexRange(const char *cursor, const char *end, int nFaces, bool trianglesOnly, int *out, unsigned int &maxIndex)
+{
+    const std::ptrdiff_t indexSize = sizeof(Index);
+    unsigned int max = 0;
+    for (int i = 0; i < nFaces; i++)
     {
-        fin.close();
-        return false;
+        if (end - cursor < static_cast<std::ptrdiff_t>(sizeof(Count)))
+            return false;
+        int n = static_cast<int>(load<Count, swap>(cursor));
+        cursor += sizeof(Count);
+        if (n < 0 || (end - cursor) / indexSize < n || (trianglesOnly && n != 3))
+            return false;
+        if (n >= 3)
+        {
+            int first = static_cast<int>(load<Index, swap>(cursor));
+            int previous = static_cast<int>(load<Index, swap>(cursor + indexSize));
+            max = std::max(max, std::max(static_cast<unsigned int>(first), static_cast<unsigned int>(previous)));
+            for (int k = 2; k < n; k++)
+            {
+                int current = static_cast<int>(load<Index, swap>(cursor + k * indexSize));
+                max = std::max(max, static_cast<unsigned int>(current));
+                out[0] = first;
+                out[1] = previous;
+                out[2] = current;
+                out += 3;
+                previous = current;
+            }
+        }
+        cursor += n * indexSize;
     }
+    maxIndex = max;
+    return true;
+}
 
-    std::vector<float> plyVertices;
-    std::vector<int> plyTriangles;
+// Every chunk of faces needs where its first face and its first triangle are. Meshes of only triangles have
+// faces of a fixed size, so this is first tried assuming so. Otherwise a pass over the counts of the faces
+// (a prefix sum of their triangles at the starts of the chunks) finds them
+template <typename Count, typename Index, bool swap>
+static bool decodeIndexLists(const char *&cursor, const char *end, int nFaces, std::vector<int> &triangles, unsigned int &maxIndex,
+                             JobSystem *jobs)
+{
+    const std::ptrdiff_t indexSize = sizeof(Index);
+    const std::ptrdiff_t triangleSize = sizeof(Count) + 3 * indexSize;
+    int chunks = numChunks(jobs, nFaces);
+    std::vector<unsigned int> chunkMaxIndex(chunks, 0);
+    std::vector<unsigned char> chunkDecoded(chunks, 0);
 
-    loadVertices(fin, nVertices, plyVertices);
-    loadFaces(fin, nFaces, plyTriangles);
-    fin.close();
+    if ((end - cursor) / triangleSize >= nFaces)
+    {
+        triangles.resize(3 * static_cast<std::size_t>(nFaces));
+        forEachChunk(jobs, chunks, [&](int firstChunk, int lastChunk) {
+            for (int c = firstChunk; c < lastChunk; c++)
+            {
+                int first = chunkBegin(c, chunks, nFaces);
+                int last = chunkBegin(c + 1, chunks, nFaces);
+                chunkDecoded[c] = decodeIndexRange<Count, Index, swap>(cursor + first * triangleSize, end, last - first, true,
+                                                                       triangles.data() + 3 * static_cast<std::size_t>(first), chunkMaxIndex[c]);
+            }
+        });
+        if (std::find(chunkDecoded.begin(), chunkDecoded.end(), 0) == chunkDecoded.end())
+        {
+            cursor += nFaces * triangleSize;
+            maxIndex = *std::max_element(chunkMaxIndex.begin(), chunkMaxIndex.end());
+            return true;
+        }
+    }
 
-    rescaleModel(plyVertices);
-    addModelToMesh(plyVertices, plyTriangles, mesh);
+    std::vector<const char *> chunkFaces(chunks);
+    std::vector<std::size_t> chunkTriangles(chunks);
+    std::size_t nTriangles = 0;
+    for (int c = 0; c < chunks; c++)
+    {
+        chunkFaces[c] = cursor;
+        chunkTriangles[c] = nTriangles;
+        int last = chunkBegin(c + 1, chunks, nFaces);
+        for (int i = chunkBegin(c, chunks, nFaces); i < last; i++)
+        {
+            if (end - cursor < static_cast<std::ptrdiff_t>(sizeof(Count)))
+                return false;
+            int n = static_cast<int>(load<Count, swap>(cursor));
+            cursor += sizeof(Count);
+            if (n < 0 || (end - cursor) / indexSize < n)
+                return false;
+            nTriangles += std::max(n - 2, 0);
+            cursor += n * indexSize;
+        }
+    }
+
+    triangles.resize(3 * nTriangles);
+    forEachChunk(jobs, chunks, [&](int firstChunk, int lastChunk) {
+        for (int c = firstChunk; c < lastChunk; c++)
+        {
+            int count = chunkBegin(c + 1, chunks, nFaces) - chunkBegin(c, chunks, nFaces);
+            decodeIndexRange<Count, Index, swap>(chunkFaces[c], end, count, false, triangles.data() + 3 * chunkTriangles[c], chunkMaxIndex[c]);
+        }
+    });
+    maxIndex = *std::max_element(chunkMaxIndex.begin(), chunkMaxIndex.end());
+    return true;
+}
 
+// Next whitespace separated number of an ascii file
+template <typename T>
+static bool parseNumber(const char *&cursor, const char *end, T &value)
+{
+    while (cursor != end && isspace(static_cast<unsigned char>(*cursor)))
+        ++cursor;
+    std::from_chars_result result = std::from_chars(cursor, end, value);
+    if (result.ec != std::errc())
+        return false;
+    cursor = result.ptr;
     return true;
 }
 
-bool PLYReader::loadHeader(std::ifstream &fin, int &nVertices, int &nFaces)
+static bool parseType(const std::string &name, PLYType &type)
+{
+    for (int i = PLY_INT8; i <= PLY_FLOAT64; i++)
+    {
+        if (name == TYPE_NAMES[i][0] || name == TYPE_NAMES[i][1])
+        {
+            type = static_cast<PLYType>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Colors stored as integers span the whole range of their type
+static float colorScale(PLYType type)
 {
-    char line[100];
+    switch (type)
+    {
+    case PLY_INT8:
+        return 1.0f / 127.0f;
+    case PLY_UINT8:
+        return 1.0f / 255.0f;
+    case PLY_INT16:
+        return 1.0f / 32767.0f;
+    case PLY_UINT16:
+        return 1.0f / 65535.0f;
+    case PLY_INT32:
+        return 1.0f / 2147483647.0f;
+    case PLY_UINT32:
+        return 1.0f / 4294967295.0f;
+    default:
+        return 1.0f;
+    }
+}
 
-    fin.getline(line, 100);
-    if (strncmp(line, "ply", 3) != 0)
+// Index of the property of each vertex field in the element, -1 when missing
+static void findVertexFields(const PLYElement &element, int properties[NUM_VERTEX_FIELDS])
+{
+    for (int field = 0; field < NUM_VERTEX_FIELDS; field++)
+    {
+        properties[field] = -1;
+        for (std::size_t i = 0; i < element.properties.size(); i++)
+            if (!element.properties[i].isList && element.properties[i].name == VERTEX_FIELD_NAMES[field])
+                properties[field] = i;
+    }
+}
+
+bool PLYReader::readMesh(const std::string &filename, TriangleMesh &mesh, JobSystem *jobs)
+{
+    MappedFile file;
+    PLYHeader header;
+
+    if (!file.open(filename))
         return false;
-    nVertices = 0;
-    fin.getline(line, 100);
-    while (strncmp(line, "end_header", 10) != 0)
+    const char *cursor = file.data();
+    const char *end = file.data() + file.size();
+    if (!loadHeader(cursor, end, header))
     {
-        if (strncmp(line, "element vertex", 14) == 0)
-            nVertices = atoi(&line[15]);
-        fin.getline(line, 100);
-        if (strncmp(line, "element face", 12) == 0)
-            nFaces = atoi(&line[13]);
+        std::cout << "Unsupported PLY header in " << filename << std::endl;
+        return false;
+    }
+
+    int nVertices = 0, nFaces = 0;
+    for (const PLYElement &element : header.elements)
+    {
+        if (element.name == "vertex")
+            nVertices = element.count;
+        else if (element.name == "face")
+            nFaces = element.count;
     }
     if (nVertices <= 0)
         return false;
@@ -57,75 +313,451 @@ bool PLYReader::loadHeader(std::ifstream &fin, int &nVertices, int &nFaces)
     std::cout << "\tFaces = " << nFaces << std::endl;
     std::cout << std::endl;
 
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec4> colors;
+    std::vector<int> triangles;
+
+    for (const PLYElement &element : header.elements)
+    {
+        bool bSuccess;
+        if (element.name == "vertex")
+            bSuccess = loadVertices(cursor, end, header.format, element, vertices, normals, colors, jobs);
+        else if (element.name == "face")
+            bSuccess = loadFaces(cursor, end, header.format, element, nVertices, triangles, jobs);
+        else
+            bSuccess = skipElement(cursor, end, header.format, element);
+        if (!bSuccess)
+        {
+            std::cout << "Truncated or corrupt PLY file " << filename << std::endl;
+            return false;
+        }
+    }
+
+    AABB bounds = rescaleModel(vertices, jobs);
+    mesh.setGeometry(std::move(vertices), std::move(triangles), bounds);
+    if (!normals.empty())
+        mesh.setNormals(std::move(normals));
+    if (!colors.empty())
+        mesh.setColors(std::move(colors));
+
     return true;
 }
 
-void PLYReader::loadVertices(std::ifstream &fin, int nVertices, std::vector<float> &plyVertices)
+// Reads the header lines, leaving the cursor at the first byte of the data
+bool PLYReader::loadHeader(const char *&cursor, const char *end, PLYHeader &header)
 {
-    int i;
-    float value;
+    std::string line;
+    bool hasFormat = false;
 
-    for (i = 0; i < nVertices; i++)
+    header.elements.clear();
+    for (int lineNumber = 0; ; ++lineNumber)
     {
-        fin.read((char *)&value, sizeof(float));
-        plyVertices.push_back(value);
-        fin.read((char *)&value, sizeof(float));
-        plyVertices.push_back(value);
-        fin.read((char *)&value, sizeof(float));
-        plyVertices.push_back(value);
+        const char *lineEnd = static_cast<const char *>(memchr(cursor, '\n', end - cursor));
+        if (lineEnd == nullptr)
+            return false;
+        line.assign(cursor, lineEnd);
+        cursor = lineEnd + 1;
+
+        std::istringstream sin(line);
+        std::string keyword;
+        sin >> keyword;
+        if (lineNumber == 0)
+        {
+            if (keyword != "ply")
+                return false;
+        }
+        else if (keyword == "end_header")
+            break;
+        else if (keyword == "format")
+        {
+            std::string format;
+            sin >> format;
+            if (format == "ascii")
+                header.format = PLY_ASCII;
+            else if (format == "binary_little_endian")
+                header.format = PLY_BINARY_LITTLE_ENDIAN;
+            else if (format == "binary_big_endian")
+                header.format = PLY_BINARY_BIG_ENDIAN;
+            else
+                return false;
+            hasFormat = true;
+        }
+        else if (keyword == "element")
+        {
+            PLYElement element;
+            if (!(sin >> element.name >> element.count) || element.count < 0)
+                return false;
+            element.recordSize = 0;
+            header.elements.push_back(element);
+        }
+        else if (keyword == "property")
+        {
+            if (header.elements.empty())
+                return false;
+            PLYProperty property;
+            std::string type;
+            sin >> type;
+            property.isList = (type == "list");
+            if (property.isList)
+            {
+                std::string countType;
+                sin >> countType >> type;
+                if (!parseType(countType, property.countType))
+                    return false;
+            }
+            if (!parseType(type, property.type) || !(sin >> property.name))
+                return false;
+            header.elements.back().properties.push_back(property);
+        }
+        // Comments and obj_info lines are ignored
+    }
+
+    for (PLYElement &element : header.elements)
+    {
+        for (const PLYProperty &property : element.properties)
+        {
+            if (property.isList)
+            {
+                element.recordSize = 0;
+                break;
+            }
+            element.recordSize += TYPE_SIZES[property.type];
+        }
     }
+    return hasFormat;
 }
 
-void PLYReader::loadFaces(std::ifstream &fin, int nFaces, std::vector<int> &plyTriangles)
+// Every present field is decoded by a decoder chosen for its type and byte order, at a fixed offset of the
+// record. Records of only the three positions in float of the host byte order are copied as a whole
+bool PLYReader::loadVertices(const char *&cursor, const char *end, PLYFormat format, const PLYElement &element,
+                             std::vector<glm::vec3> &vertices, std::vector<glm::vec3> &normals, std::vector<glm::vec4> &colors,
+                             JobSystem *jobs)
 {
-    int i, tri[3];
-    unsigned char nVrtxPerFace;
+    struct Field
+    {
+        int property;
+        FloatDecoder decode;
+        int offset;         // In the binary record
+        float scale;
+        float *out;
+        int outStride;      // In floats
+    };
 
-    for (i = 0; i < nFaces; i++)
+    int properties[NUM_VERTEX_FIELDS];
+    findVertexFields(element, properties);
+    if (properties[0] == -1 || properties[1] == -1 || properties[2] == -1)
+        return false;
+    bool hasNormals = properties[3] != -1 && properties[4] != -1 && properties[5] != -1;
+    bool hasColors = properties[6] != -1 && properties[7] != -1 && properties[8] != -1;
+    for (const PLYProperty &property : element.properties)
+        if (property.isList)
+            return false;
+
+    // The count comes from the header, the arrays are only sized once the data left can hold that many records
+    if (element.count == 0)
+        return true;
+    std::size_t remaining = end - cursor;
+    std::size_t size = static_cast<std::size_t>(element.count) * element.recordSize;
+    if (format == PLY_ASCII)
     {
-        fin.read((char *)&nVrtxPerFace, sizeof(unsigned char));
-        fin.read((char *)&tri[0], sizeof(int));
-        fin.read((char *)&tri[1], sizeof(int));
-        fin.read((char *)&tri[2], sizeof(int));
-        plyTriangles.push_back(tri[0]);
-        plyTriangles.push_back(tri[1]);
-        plyTriangles.push_back(tri[2]);
-        for (; nVrtxPerFace > 3; nVrtxPerFace--)
+        // Every value takes at least a digit and a separator, but the last one of the file
+        if (2 * static_cast<std::size_t>(element.count) * element.properties.size() > remaining + 1)
+            return false;
+    }
+    else if (remaining < size)
+        return false;
+
+    vertices.resize(element.count);
+    if (hasNormals)
+        normals.resize(element.count);
+    if (hasColors)
+        colors.assign(element.count, glm::vec4(1.0f));
+
+    Field fields[NUM_VERTEX_FIELDS];
+    int nFields = 0;
+    for (int field = 0; field < NUM_VERTEX_FIELDS; field++)
+    {
+        if (properties[field] == -1)
+            continue;
+        if (field >= FIRST_NORMAL_FIELD && field < FIRST_COLOR_FIELD && !hasNormals)
+            continue;
+        if (field >= FIRST_COLOR_FIELD && !hasColors)
+            continue;
+
+        Field &f = fields[nFields++];
+        const PLYProperty &property = element.properties[properties[field]];
+        f.property = properties[field];
+        f.decode = floatDecoder(format, property.type);
+        f.offset = 0;
+        for (int i = 0; i < f.property; i++)
+            f.offset += TYPE_SIZES[element.properties[i].type];
+        f.scale = 1.0f;
+        if (field < FIRST_NORMAL_FIELD)
         {
-            tri[1] = tri[2];
-            fin.read((char *)&tri[2], sizeof(int));
-            plyTriangles.push_back(tri[0]);
-            plyTriangles.push_back(tri[1]);
-            plyTriangles.push_back(tri[2]);
+            f.out = &vertices[0][field];
+            f.outStride = 3;
         }
+        else if (field < FIRST_COLOR_FIELD)
+        {
+            f.out = &normals[0][field - FIRST_NORMAL_FIELD];
+            f.outStride = 3;
+        }
+        else
+        {
+            f.out = &colors[0][field - FIRST_COLOR_FIELD];
+            f.outStride = 4;
+            f.scale = colorScale(property.type);
+        }
+    }
+
+    if (format == PLY_ASCII)
+    {
+        std::vector<double> values(element.properties.size());
+        for (int v = 0; v < element.count; v++)
+        {
+            for (double &value : values)
+                if (!parseNumber(cursor, end, value))
+                    return false;
+            for (int i = 0; i < nFields; i++)
+                fields[i].out[v * fields[i].outStride] = static_cast<float>(values[fields[i].property]) * fields[i].scale;
+        }
+        return true;
     }
+
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "glm::vec3 must be packed");
+    bool packedPositions = element.recordSize == sizeof(glm::vec3) && nFields == 3 && !swapsBytes(format);
+    for (int i = 0; i < nFields && packedPositions; i++)
+        packedPositions = element.properties[fields[i].property].type == PLY_FLOAT32 && fields[i].offset == 4 * i;
+    int chunks = numChunks(jobs, element.count);
+    forEachChunk(jobs, chunks, [&](int firstChunk, int lastChunk) {
+        int first = chunkBegin(firstChunk, chunks, element.count);
+        int last = chunkBegin(lastChunk, chunks, element.count);
+        const char *record = cursor + static_cast<std::size_t>(first) * element.recordSize;
+        if (packedPositions)
+        {
+            memcpy(vertices.data() + first, record, static_cast<std::size_t>(last - first) * element.recordSize);
+            return;
+        }
+        for (int v = first; v < last; v++, record += element.recordSize)
+            for (int i = 0; i < nFields; i++)
+                fields[i].out[v * fields[i].outStride] = fields[i].decode(record + fields[i].offset) * fields[i].scale;
+    });
+    cursor += size;
+    return true;
 }
 
-void PLYReader::rescaleModel(std::vector<float> &plyVertices)
+// Polygons are triangulated as fans around their first vertex, the other properties of the faces are skipped
+bool PLYReader::loadFaces(const char *&cursor, const char *end, PLYFormat format, const PLYElement &element,
+                          int nVertices, std::vector<int> &triangles, JobSystem *jobs)
 {
-    glm::vec3 min(std::numeric_limits<float>::max());
-    glm::vec3 max(-std::numeric_limits<float>::max());
+    int indices = -1;
+    for (std::size_t i = 0; i < element.properties.size(); i++)
+    {
+        const PLYProperty &property = element.properties[i];
+        if (property.isList && (property.name == "vertex_indices" || property.name == "vertex_index"))
+            indices = i;
+    }
+    if (indices == -1)
+        return false;
+
+    // A face takes at least four bytes (a count and three indices of a byte), so a bad count in the header
+    // can't reserve more than the data could hold
+    triangles.clear();
+    triangles.reserve(3 * std::min(static_cast<std::size_t>(element.count), static_cast<std::size_t>(end - cursor) / 4));
+    unsigned int maxIndex = 0;
 
-    for (std::size_t i = 0; i < plyVertices.size(); i += 3)
+    if (format == PLY_ASCII)
+    {
+        for (int i = 0; i < element.count; i++)
+        {
+            for (std::size_t p = 0; p < element.properties.size(); p++)
+            {
+                const PLYProperty &property = element.properties[p];
+                int n = 1;
+                if (property.isList && !parseNumber(cursor, end, n))
+                    return false;
+                if (p != static_cast<std::size_t>(indices))
+                {
+                    double value;
+                    for (int k = 0; k < n; k++)
+                        if (!parseNumber(cursor, end, value))
+                            return false;
+                    continue;
+                }
+
+                int first = 0, previous = 0, current;
+                for (int k = 0; k < n; k++)
+                {
+                    if (!parseNumber(cursor, end, current))
+                        return false;
+                    maxIndex = std::max(maxIndex, static_cast<unsigned int>(current));
+                    if (k == 0)
+                        first = current;
+                    else if (k >= 2)
+                    {
+                        triangles.push_back(first);
+                        triangles.push_back(previous);
+                        triangles.push_back(current);
+                    }
+                    previous = current;
+                }
+            }
+        }
+    }
+    else if (element.properties.size() == 1 && element.properties[0].countType == PLY_UINT8 &&
+             (element.properties[0].type == PLY_INT32 || element.properties[0].type == PLY_UINT32))
     {
-        min = glm::min(min, glm::vec3(plyVertices[i], plyVertices[i+1], plyVertices[i+2]));
-        max = glm::max(max, glm::vec3(plyVertices[i], plyVertices[i+1], plyVertices[i+2]));
+        bool swap = swapsBytes(format);
+        if (!(swap ? decodeIndexLists<std::uint8_t, std::int32_t, true>(cursor, end, element.count, triangles, maxIndex, jobs)
+                   : decodeIndexLists<std::uint8_t, std::int32_t, false>(cursor, end, element.count, triangles, maxIndex, jobs)))
+            return false;
     }
+    else
+    {
+        // Size of every property, or of the count and of each item for the lists
+        struct Step
+        {
+            int size;
+            IntDecoder decodeCount;
+            int itemSize;
+        };
+        std::vector<Step> steps;
+        for (const PLYProperty &property : element.properties)
+        {
+            Step step;
+            step.size = TYPE_SIZES[property.isList ? property.countType : property.type];
+            step.decodeCount = property.isList ? intDecoder(format, property.countType) : nullptr;
+            step.itemSize = property.isList ? TYPE_SIZES[property.type] : 0;
+            steps.push_back(step);
+        }
+        IntDecoder decodeIndex = intDecoder(format, element.properties[indices].type);
+        int indexSize = TYPE_SIZES[element.properties[indices].type];
 
-    glm::vec3 center = (min + max) / 2.0f;
-    float largestSize = std::max(max.x - min.x, std::max(max.y - min.y, max.z - min.z));
-    for (std::size_t i = 0; i < plyVertices.size(); i += 3)
+        for (int i = 0; i < element.count; i++)
+        {
+            for (std::size_t p = 0; p < steps.size(); p++)
+            {
+                const Step &step = steps[p];
+                if (end - cursor < step.size)
+                    return false;
+                if (step.decodeCount == nullptr)
+                {
+                    cursor += step.size;
+                    continue;
+                }
+                int n = step.decodeCount(cursor);
+                cursor += step.size;
+                if (n < 0 || (end - cursor) / step.itemSize < n)
+                    return false;
+                if (p == static_cast<std::size_t>(indices) && n >= 3)
+                {
+                    int first = decodeIndex(cursor);
+                    int previous = decodeIndex(cursor + indexSize);
+                    maxIndex = std::max(maxIndex, std::max(static_cast<unsigned int>(first), static_cast<unsigned int>(previous)));
+                    for (int k = 2; k < n; k++)
+                    {
+                        int current = decodeIndex(cursor + k * indexSize);
+                        maxIndex = std::max(maxIndex, static_cast<unsigned int>(current));
+                        triangles.push_back(first);
+                        triangles.push_back(previous);
+                        triangles.push_back(current);
+                        previous = current;
+                    }
+                }
+                cursor += n * step.itemSize;
+            }
+        }
+    }
+
+    // A negative index is above any valid one as unsigned
+    return triangles.empty() || maxIndex < static_cast<unsigned int>(nVertices);
+}
+
+bool PLYReader::skipElement(const char *&cursor, const char *end, PLYFormat format, const PLYElement &element)
+{
+    if (format != PLY_ASCII && element.recordSize > 0)
     {
-        plyVertices[i] = (plyVertices[i] - center[0]) / largestSize;
-        plyVertices[i + 1] = (plyVertices[i + 1] - center[1]) / largestSize;
-        plyVertices[i + 2] = (plyVertices[i + 2] - center[2]) / largestSize;
+        std::size_t size = static_cast<std::size_t>(element.count) * element.recordSize;
+        if (static_cast<std::size_t>(end - cursor) < size)
+            return false;
+        cursor += size;
+        return true;
     }
+
+    for (int i = 0; i < element.count; i++)
+    {
+        for (const PLYProperty &property : element.properties)
+        {
+            int n = 1;
+            if (format == PLY_ASCII)
+            {
+                double value;
+                if (property.isList && !parseNumber(cursor, end, n))
+                    return false;
+                for (int k = 0; k < n; k++)
+                    if (!parseNumber(cursor, end, value))
+                        return false;
+                continue;
+            }
+
+            if (property.isList)
+            {
+                int countSize = TYPE_SIZES[property.countType];
+                if (end - cursor < countSize)
+                    return false;
+                n = intDecoder(format, property.countType)(cursor);
+                cursor += countSize;
+            }
+            if (n < 0 || (end - cursor) / TYPE_SIZES[property.type] < n)
+                return false;
+            cursor += n * TYPE_SIZES[property.type];
+        }
+    }
+    return true;
 }
 
-void PLYReader::addModelToMesh(const std::vector<float> &plyVertices, const std::vector<int> &plyTriangles, TriangleMesh &mesh)
+// Centers the model at the origin with a largest side of 1, returns its new bounds
+AABB PLYReader::rescaleModel(std::vector<glm::vec3> &vertices, JobSystem *jobs)
 {
-    for (std::size_t i = 0; i < plyVertices.size(); i += 3)
-        mesh.addVertex(glm::vec3(plyVertices[i], plyVertices[i + 1], plyVertices[i + 2]));
-    for (std::size_t i = 0; i < plyTriangles.size(); i += 3)
-        mesh.addTriangle(plyTriangles[i], plyTriangles[i + 1], plyTriangles[i + 2]);
+    int count = vertices.size();
+    int chunks = numChunks(jobs, count);
+    std::vector<AABB> chunkBounds(chunks);
+    forEachChunk(jobs, chunks, [&](int firstChunk, int lastChunk) {
+        for (int c = firstChunk; c < lastChunk; c++)
+        {
+            glm::vec3 min(std::numeric_limits<float>::max());
+            glm::vec3 max(-std::numeric_limits<float>::max());
+            int last = chunkBegin(c + 1, chunks, count);
+            for (int v = chunkBegin(c, chunks, count); v < last; v++)
+            {
+                min = glm::min(min, vertices[v]);
+                max = glm::max(max, vertices[v]);
+            }
+            chunkBounds[c].min = min;
+            chunkBounds[c].max = max;
+        }
+    });
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(-std::numeric_limits<float>::max());
+    for (const AABB &bounds : chunkBounds)
+    {
+        min = glm::min(min, bounds.min);
+        max = glm::max(max, bounds.max);
+    }
+
+    glm::vec3 center = (min + max) / 2.0f;
+    float largestSize = std::max(max.x - min.x, std::max(max.y - min.y, max.z - min.z));
+    forEachChunk(jobs, chunks, [&](int firstChunk, int lastChunk) {
+        int last = chunkBegin(lastChunk, chunks, count);
+        for (int v = chunkBegin(firstChunk, chunks, count); v < last; v++)
+            vertices[v] = (vertices[v] - center) / largestSize;
+    });
+
+    // The transform is monotonic, so the extreme vertices stay the extreme ones
+    AABB bounds;
+    bounds.min = (min - center) / largestSize;
+    bounds.max = (max - center) / largestSize;
+    return bounds;
 }
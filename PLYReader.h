@@ -1,24 +1,74 @@
 #ifndef PLYREADER_H
 #define PLYREADER_H
 
-#include <fstream>
 #include <string>
 #include <vector>
 
+#include "JobSystem.h"
 #include "TriangleMesh.h"
 
+enum PLYFormat
+{
+    PLY_ASCII,
+    PLY_BINARY_LITTLE_ENDIAN,
+    PLY_BINARY_BIG_ENDIAN
+};
+
+enum PLYType
+{
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64
+};
+
+struct PLYProperty
+{
+    std::string name;
+    PLYType type;           // Of the items for lists
+    bool isList;
+    PLYType countType;      // Lists only
+};
+
+struct PLYElement
+{
+    std::string name;
+    int count;
+    std::vector<PLYProperty> properties;
+    int recordSize;         // Bytes of a binary record, 0 when it has lists
+};
+
+struct PLYHeader
+{
+    PLYFormat format;
+    std::vector<PLYElement> elements;
+};
+
+// PLY files in any of the three formats, with any property types and orders
+// The positions, normals and colors of the vertices and the faces (triangulated as fans) are read,
+// any other element or property is skipped. The file is memory mapped and the binary records are decoded
+// by decoders chosen once per property from the header, with bulk copies when the layout allows them.
+// Given a job system, the binary vertex and face blocks of the usual layouts and the rescale are split in
+// chunks decoded in parallel
 class PLYReader
 {
 
 public:
-    static bool readMesh(const std::string &filename, TriangleMesh &mesh);
+    static bool readMesh(const std::string &filename, TriangleMesh &mesh, JobSystem *jobs = nullptr);
 
 private:
-    static bool loadHeader(std::ifstream &fin, int &nVertices, int &nFaces);
-    static void loadVertices(std::ifstream &fin, int nVertices, std::vector<float> &plyVertices);
-    static void loadFaces(std::ifstream &fin, int nFaces, std::vector<int> &plyTriangles);
-    static void rescaleModel(std::vector<float> &plyVertices);
-    static void addModelToMesh(const std::vector<float> &plyVertices, const std::vector<int> &plyTriangles, TriangleMesh &mesh);
+    static bool loadHeader(const char *&cursor, const char *end, PLYHeader &header);
+    static bool loadVertices(const char *&cursor, const char *end, PLYFormat format, const PLYElement &element,
+                             std::vector<glm::vec3> &vertices, std::vector<glm::vec3> &normals, std::vector<glm::vec4> &colors,
+                             JobSystem *jobs);
+    static bool loadFaces(const char *&cursor, const char *end, PLYFormat format, const PLYElement &element,
+                          int nVertices, std::vector<int> &triangles, JobSystem *jobs);
+    static bool skipElement(const char *&cursor, const char *end, PLYFormat format, const PLYElement &element);
+    static AABB rescaleModel(std::vector<glm::vec3> &vertices, JobSystem *jobs);
 };
 
 #endif // PLYREADER_H
@@ -0,0 +1,166 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+void PerfCounts::clear()
+{
+    cycles = 0;
+    instructions = 0;
+    cacheMisses = 0;
+    branchMisses = 0;
+}
+
+PerfCounts &PerfCounts::operator+=(const PerfCounts &other)
+{
+    cycles += other.cycles;
+    instructions += other.instructions;
+    cacheMisses += other.cacheMisses;
+    branchMisses += other.branchMisses;
+    return *this;
+}
+
+PerfCounts PerfCounts::operator-(const PerfCounts &other) const
+{
+    PerfCounts difference;
+    difference.cycles = cycles - other.cycles;
+    difference.instructions = instructions - other.instructions;
+    difference.cacheMisses = cacheMisses - other.cacheMisses;
+    difference.branchMisses = branchMisses - other.branchMisses;
+    return difference;
+}
+
+
+PerfCounters::PerfCounters()
+    : leader(-1)
+    , numOpened(0)
+{
+    for (int i = 0; i < NUM_EVENTS; ++i) {
+        fds[i] = -1;
+        slot[i] = -1;
+    }
+    beginFrame();
+}
+
+PerfCounters::~PerfCounters()
+{
+    close();
+}
+
+bool PerfCounters::open()
+{
+    if (available()) return true;
+
+#ifdef __linux__
+    const unsigned long long events[NUM_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    // Cycles lead the group, the other events are optional (e.g. missing in virtual machines)
+    for (int i = 0; i < NUM_EVENTS; ++i) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = events[i];
+        attr.disabled = (i == 0);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        if (fd == -1) {
+            if (i == 0) return false;
+            continue;
+        }
+        if (i == 0) leader = fd;
+        fds[i] = fd;
+        slot[i] = numOpened++;
+    }
+
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PerfCounters::close()
+{
+#ifdef __linux__
+    for (int i = 0; i < NUM_EVENTS; ++i) {
+        if (fds[i] != -1) ::close(fds[i]);
+        fds[i] = -1;
+        slot[i] = -1;
+    }
+#endif
+    leader = -1;
+    numOpened = 0;
+}
+
+void PerfCounters::sample(PerfCounts &counts) const
+{
+    long long values[NUM_EVENTS] = {0, 0, 0, 0};
+
+#ifdef __linux__
+    if (available()) {
+        // Group read format: number of events followed by their values
+        unsigned long long buffer[1 + NUM_EVENTS];
+        if (read(leader, buffer, sizeof(buffer)) > 0) {
+            for (int i = 0; i < NUM_EVENTS; ++i)
+                if (slot[i] != -1) values[i] = buffer[1 + slot[i]];
+        }
+    }
+#endif
+
+    counts.cycles = values[0];
+    counts.instructions = values[1];
+    counts.cacheMisses = values[2];
+    counts.branchMisses = values[3];
+}
+
+void PerfCounters::beginFrame()
+{
+    for (int i = 0; i < NUM_PERF_PHASES; ++i)
+        accumulated[i].clear();
+}
+
+void PerfCounters::begin(PerfPhase phase)
+{
+    if (!available()) return;
+    sample(started[phase]);
+}
+
+void PerfCounters::end(PerfPhase phase)
+{
+    if (!available()) return;
+    PerfCounts counts;
+    sample(counts);
+    accumulated[phase] += counts - started[phase];
+}
+
+const char *PerfCounters::phaseName(PerfPhase phase)
+{
+    switch (phase) {
+        case PERF_FRUSTUM_CULLING:
+            return "frustum_culling";
+        case PERF_HIERARCHY_TRAVERSAL:
+            return "hierarchy_traversal";
+        case PERF_QUERY_POLLING:
+            return "query_polling";
+        case PERF_SORTING:
+            return "sorting";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef _PERF_COUNTERS_INCLUDE
+#define _PERF_COUNTERS_INCLUDE
+
+// Hardware counters of a region of code
+struct PerfCounts
+{
+    long long cycles;
+    long long instructions;
+    long long cacheMisses;
+    long long branchMisses;
+
+    void clear();
+    PerfCounts &operator+=(const PerfCounts &other);
+    PerfCounts operator-(const PerfCounts &other) const;
+};
+
+// Named phases of a frame whose counters are reported separately
+enum PerfPhase
+{
+    PERF_FRUSTUM_CULLING,
+    PERF_HIERARCHY_TRAVERSAL,
+    PERF_QUERY_POLLING,
+    PERF_SORTING,
+    NUM_PERF_PHASES
+};
+
+// Linux hardware performance counters (perf_event_open) of the calling thread, accumulated per phase
+// When the counters can not be opened (other platforms, containers, restrictive perf_event_paranoid)
+// open returns false and every reading is zero, so callers do not need to check
+// Every begin/end pair costs a system call, keep the phases coarse
+class PerfCounters
+{
+
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    bool open();
+    void close();
+    bool available() const {return leader != -1;}
+
+    // Current value of the counters, zero when not available
+    void sample(PerfCounts &counts) const;
+
+    // Phase accumulation, cleared at the beginning of every frame
+    void beginFrame();
+    void begin(PerfPhase phase);
+    void end(PerfPhase phase);
+    const PerfCounts &getPhase(PerfPhase phase) const {return accumulated[phase];}
+
+    static const char *phaseName(PerfPhase phase);
+
+private:
+    static const int NUM_EVENTS = 4;
+
+    int leader;
+    int fds[NUM_EVENTS];
+    int numOpened;
+    int slot[NUM_EVENTS];      // Position of each event in the group read, -1 if it could not be opened
+
+    PerfCounts started[NUM_PERF_PHASES];
+    PerfCounts accumulated[NUM_PERF_PHASES];
+};
+
+// Counts the lifetime of the object into a phase
+class PerfScope
+{
+
+public:
+    PerfScope(PerfCounters &counters, PerfPhase phase)
+        : counters(counters)
+        , phase(phase)
+    {
+        counters.begin(phase);
+    }
+
+    ~PerfScope()
+    {
+        counters.end(phase);
+    }
+
+private:
+    PerfCounters &counters;
+    PerfPhase phase;
+};
+
+#endif // _PERF_COUNTERS_INCLUDE
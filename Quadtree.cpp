@@ -0,0 +1,302 @@
+#include "Quadtree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+// Interleaves the bits of the cell coordinates, x in the even bits and z in the odd ones,
+// which is the position of the leaf among the leaves of the implicit quadtree
+static unsigned int mortonCode(unsigned int x, unsigned int z)
+{
+    unsigned int code = 0;
+    for (int bit = 0; bit < Quadtree::MAX_DEPTH; ++bit) {
+        code |= ((x >> bit) & 1) << (2 * bit);
+        code |= ((z >> bit) & 1) << (2 * bit + 1);
+    }
+    return code;
+}
+
+
+void Quadtree::build(const std::vector<AABB> &objectBounds, unsigned int currentFrame, Layout layout)
+{
+    int numObjects = objectBounds.size();
+    depth = 0;
+    while ((1 << (2 * depth)) < numObjects && depth < MAX_DEPTH) ++depth;
+
+    // Number of nodes of a full quadtree with depth levels, built in breadth first order
+    // (children of i at 4i+1 .. 4i+4) and then moved to the requested layout
+    int numNodes = (std::pow(4, depth + 1) - 1)/ 3;
+    int firstLeaf = (numNodes - 1) / 4;
+    int numLeaves = numNodes - firstLeaf;
+    bounds.assign(numNodes, AABB());
+    split.assign(numNodes, glm::vec2(0.0f));
+    state.assign(numNodes, VISIBLE | (currentFrame & ~VISIBLE));
+    objectRange.assign(numNodes, glm::ivec2(0));
+    firstChild.resize(numNodes);
+    parents.resize(numNodes);
+    for (int i = 0; i < numNodes; ++i) {
+        firstChild[i] = (i < firstLeaf) ? 4 * i + 1 : -1;
+        parents[i] = (i > 0) ? (i - 1) / 4 : -1;
+    }
+
+    AABB sceneBounds = objectBounds[0];
+    for (const AABB &aabb : objectBounds) {
+        sceneBounds.min = glm::min(sceneBounds.min, aabb.min);
+        sceneBounds.max = glm::max(sceneBounds.max, aabb.max);
+    }
+    glm::vec2 regionMin(sceneBounds.min.x, sceneBounds.min.z);
+    glm::vec2 regionMax(sceneBounds.max.x, sceneBounds.max.z);
+    buildRegions(root(), regionMin, regionMax);
+
+    // Leaf of every object and counting sort of the objects by leaf
+    int side = 1 << depth;
+    glm::vec2 cellSize = glm::max((regionMax - regionMin) / float(side), glm::vec2(1e-6f));
+    std::vector<int> leaf(numObjects);
+    std::vector<int> offsets(numLeaves + 1, 0);
+    for (int i = 0; i < numObjects; ++i) {
+        const AABB &aabb = objectBounds[i];
+        glm::vec2 center((aabb.min.x + aabb.max.x) / 2.0f, (aabb.min.z + aabb.max.z) / 2.0f);
+        glm::ivec2 cell = glm::clamp(glm::ivec2((center - regionMin) / cellSize), glm::ivec2(0), glm::ivec2(side - 1));
+        leaf[i] = mortonCode(cell.x, cell.y);
+        ++offsets[leaf[i] + 1];
+    }
+    for (int i = 0; i < numLeaves; ++i) offsets[i + 1] += offsets[i];
+
+    maxLeafObjects = 0;
+    for (int i = 0; i < numLeaves; ++i) {
+        objectRange[firstLeaf + i] = glm::ivec2(offsets[i], offsets[i + 1]);
+        maxLeafObjects = std::max(maxLeafObjects, offsets[i + 1] - offsets[i]);
+    }
+    objects.resize(numObjects);
+    for (int i = 0; i < numObjects; ++i) objects[offsets[leaf[i]]++] = i;
+
+    // Bottom up, the objects of a node are the ones of its children (the leaves below a node are contiguous)
+    for (int i = numNodes - 1; i >= 0; --i) {
+        AABB &aabb = bounds[i];
+        if (isLeaf(i)) {
+            if (isEmpty(i)) continue;
+            aabb = objectBounds[objects[objectRange[i].x]];
+            for (int k = objectRange[i].x; k < objectRange[i].y; ++k) {
+                aabb.min = glm::min(aabb.min, objectBounds[objects[k]].min);
+                aabb.max = glm::max(aabb.max, objectBounds[objects[k]].max);
+            }
+        }
+        else {
+            objectRange[i] = glm::ivec2(objectRange[4 * i + 1].x, objectRange[4 * i + 4].y);
+            bool first = true;
+            for (int k = 1; k <= 4; ++k) {
+                if (isEmpty(4 * i + k)) continue;
+                const AABB &child = bounds[4 * i + k];
+                aabb.min = first ? child.min : glm::min(aabb.min, child.min);
+                aabb.max = first ? child.max : glm::max(aabb.max, child.max);
+                first = false;
+            }
+        }
+    }
+
+    this->layout = BREADTH_FIRST;
+    if (layout != BREADTH_FIRST) applyLayout(layout);
+
+    objectLeaf.resize(numObjects);
+    for (int i = 0; i < numNodes; ++i) {
+        if (!isLeaf(i)) continue;
+        for (int k = objectRange[i].x; k < objectRange[i].y; ++k) objectLeaf[objects[k]] = i;
+    }
+    dirty.assign(numNodes, 0);
+    dirtyNodes.clear();
+    dirtyNodes.reserve(numNodes);
+    weightedArea = 0.0;
+    for (int i = 0; i < numNodes; ++i) weightedArea += nodeCost(i);
+    buildCost = getCost();
+}
+
+
+// Inner nodes cost a traversal step and leaves a test per object, both weighted by their area
+double Quadtree::nodeCost(QuadtreeNodeIndex i)
+{
+    if (isEmpty(i)) return 0.0;
+    return surfaceArea(bounds[i]) * (isLeaf(i) ? numObjects(i) : 1);
+}
+
+
+float Quadtree::getCost() const
+{
+    float rootArea = surfaceArea(bounds[0]);
+    return rootArea > 0.0f ? weightedArea / rootArea : 0.0f;
+}
+
+
+void Quadtree::refitNode(const std::vector<AABB> &objectBounds, QuadtreeNodeIndex i)
+{
+    if (isEmpty(i)) return;
+    weightedArea -= nodeCost(i);
+    AABB &aabb = bounds[i];
+    if (isLeaf(i)) {
+        aabb = objectBounds[objects[objectRange[i].x]];
+        for (int k = objectRange[i].x + 1; k < objectRange[i].y; ++k) {
+            aabb.min = glm::min(aabb.min, objectBounds[objects[k]].min);
+            aabb.max = glm::max(aabb.max, objectBounds[objects[k]].max);
+        }
+    }
+    else {
+        bool first = true;
+        for (int k = firstChild[i]; k < firstChild[i] + 4; ++k) {
+            if (isEmpty(k)) continue;
+            aabb.min = first ? bounds[k].min : glm::min(aabb.min, bounds[k].min);
+            aabb.max = first ? bounds[k].max : glm::max(aabb.max, bounds[k].max);
+            first = false;
+        }
+    }
+    weightedArea += nodeCost(i);
+}
+
+
+void Quadtree::refit(const std::vector<AABB> &objectBounds, const std::vector<int> &movedObjects)
+{
+    // Every moved object dirties the path from its leaf to the root, shared parts only once
+    for (int object : movedObjects) {
+        int i = objectLeaf[object];
+        while (i != -1 && !dirty[i]) {
+            dirty[i] = 1;
+            dirtyNodes.push_back(i);
+            i = parents[i];
+        }
+    }
+
+    // In every layout the children of a node come after it, so they are refitted in decreasing index order
+    // (scanning the flags when many nodes are dirty, sorting the dirty ones otherwise)
+    int numNodes = dirty.size();
+    if (8 * dirtyNodes.size() > dirty.size()) {
+        for (int i = numNodes - 1; i >= 0; --i) {
+            if (!dirty[i]) continue;
+            refitNode(objectBounds, i);
+            dirty[i] = 0;
+        }
+    }
+    else {
+        std::sort(dirtyNodes.begin(), dirtyNodes.end(), std::greater<int>());
+        for (int i : dirtyNodes) {
+            refitNode(objectBounds, i);
+            dirty[i] = 0;
+        }
+    }
+    dirtyNodes.clear();
+}
+
+
+void Quadtree::refitAll(const std::vector<AABB> &objectBounds)
+{
+    for (std::size_t i = size(); i-- > 0;) refitNode(objectBounds, i);
+    weightedArea = 0.0;
+    for (std::size_t i = 0; i < size(); ++i) weightedArea += nodeCost(i);
+}
+
+
+// Children bl, br, tl, tr: bit 0 of the child is the x half and bit 1 the z half
+void Quadtree::buildRegions(QuadtreeNodeIndex nodeIndex, const glm::vec2 &regionMin, const glm::vec2 &regionMax)
+{
+    glm::vec2 center = (regionMin + regionMax) / 2.0f;
+    split[nodeIndex] = center;
+    if (isLeaf(nodeIndex)) return;
+
+    buildRegions(4 * nodeIndex + 1, regionMin, center);
+    buildRegions(4 * nodeIndex + 2, glm::vec2(center.x, regionMin.y), glm::vec2(regionMax.x, center.y));
+    buildRegions(4 * nodeIndex + 3, glm::vec2(regionMin.x, center.y), glm::vec2(center.x, regionMax.y));
+    buildRegions(4 * nodeIndex + 4, center, regionMax);
+}
+
+
+// Order of the children (bl, br, tl, tr) given the quadrant of the viewpoint relative to the center
+// of the node and which of the split axes it is closer to: the child containing the viewpoint first,
+// then its neighbour across the closer split, then the other neighbour and finally the opposite child
+static const int childOrder[8][4] = {
+    {0, 1, 2, 3}, {1, 0, 3, 2}, {2, 3, 0, 1}, {3, 2, 1, 0},     // Closer to the x split
+    {0, 2, 1, 3}, {1, 3, 0, 2}, {2, 0, 3, 1}, {3, 1, 2, 0}      // Closer to the z split
+};
+
+
+// Front to back order from a precomputed table, no distances nor sorting needed
+int Quadtree::childrenFrontToBack(QuadtreeNodeIndex i, const glm::vec3 &viewpoint, QuadtreeNodeIndex children[4]) const
+{
+    const glm::vec2 &center = split[i];
+    glm::vec2 d(viewpoint.x - center.x, viewpoint.z - center.y);
+
+    int quadrant = 0;
+    if (d.x > 0.0f) quadrant |= 1;
+    if (d.y > 0.0f) quadrant |= 2;
+    if (std::abs(d.y) < std::abs(d.x)) quadrant |= 4;
+
+    for (int k = 0; k < 4; ++k)
+        children[k] = firstChild[i] + childOrder[quadrant][k];
+    return 4;
+}
+
+
+// Appends to order the groups of children below node (breadth first index) for the given number of levels,
+// first the groups of the top half of the levels and then, one by one, the subtrees below them
+static void vanEmdeBoasOrder(int node, int levels, std::vector<int> &order)
+{
+    if (levels == 0) return;
+    if (levels == 1) {
+        for (int k = 1; k <= 4; ++k) order.push_back(4 * node + k);
+        return;
+    }
+
+    int topLevels = levels / 2;
+    vanEmdeBoasOrder(node, topLevels, order);
+
+    std::vector<int> frontier(1, node);
+    for (int level = 0; level < topLevels; ++level) {
+        std::vector<int> next;
+        next.reserve(4 * frontier.size());
+        for (int parent : frontier)
+            for (int k = 1; k <= 4; ++k) next.push_back(4 * parent + k);
+        frontier.swap(next);
+    }
+    for (int subtree : frontier) vanEmdeBoasOrder(subtree, levels - topLevels, order);
+}
+
+
+// Appends to order the children of node (breadth first index) and then the subtree of every child
+static void depthFirstOrder(int node, int levels, std::vector<int> &order)
+{
+    if (levels == 0) return;
+    for (int k = 1; k <= 4; ++k) order.push_back(4 * node + k);
+    for (int k = 1; k <= 4; ++k) depthFirstOrder(4 * node + k, levels - 1, order);
+}
+
+
+// Moves the nodes from breadth first order to the given layout, keeping the children of a node together
+void Quadtree::applyLayout(Layout layout)
+{
+    int numNodes = size();
+    std::vector<int> order(1, 0);
+    order.reserve(numNodes);
+    if (layout == DEPTH_FIRST) depthFirstOrder(0, depth, order);
+    else vanEmdeBoasOrder(0, depth, order);
+
+    std::vector<int> position(numNodes);
+    for (int i = 0; i < numNodes; ++i) position[order[i]] = i;
+
+    std::vector<AABB> newBounds(numNodes);
+    std::vector<int> newFirstChild(numNodes), newParents(numNodes);
+    std::vector<glm::vec2> newSplit(numNodes);
+    std::vector<unsigned int> newState(numNodes);
+    std::vector<glm::ivec2> newObjectRange(numNodes);
+    for (int i = 0; i < numNodes; ++i) {
+        int old = order[i];
+        newBounds[i] = bounds[old];
+        newFirstChild[i] = firstChild[old] < 0 ? -1 : position[firstChild[old]];
+        newParents[i] = parents[old] < 0 ? -1 : position[parents[old]];
+        newSplit[i] = split[old];
+        newState[i] = state[old];
+        newObjectRange[i] = objectRange[old];
+    }
+    bounds.swap(newBounds);
+    firstChild.swap(newFirstChild);
+    parents.swap(newParents);
+    split.swap(newSplit);
+    state.swap(newState);
+    objectRange.swap(newObjectRange);
+    this->layout = layout;
+}
@@ -1,24 +1,67 @@
-#include "TriangleMesh.h"
+#ifndef _QUADTREE_INCLUDE
+#define _QUADTREE_INCLUDE
+
+#include "AABB.h"
 
 #include "glm/glm.hpp"
 
 #include <vector>
 
-struct QuadtreeNode
-{
-    AABB aabb;
-    glm::ivec2 gridPosition; // Used for leaf nodes to render the object
-    bool visible; // TODO: Previous or current frame (?)
-    unsigned int lastVisited;
-};
-
 using QuadtreeNodeIndex = std::size_t;
 
-// Quadtree represented as a simple vector (Morton Codes)
+// Full quadtree stored as a structure of arrays
+// The traversal reads the bounds, the links and the state of the nodes it visits, so they are kept in
+// separate compact arrays from the object ranges (only needed at the leaves). The four children of a
+// node are always contiguous, the order of these groups in the arrays is given by the layout
 struct Quadtree
 {
-    std::vector<QuadtreeNode> nodes;
-    
+    // Deepest hierarchy built, larger scenes get more objects per leaf instead
+    static const int MAX_DEPTH = 8;
+
+    enum Layout
+    {
+        BREADTH_FIRST,          // Level by level
+        DEPTH_FIRST,            // The subtree of a child right after the children of its parent
+        VAN_EMDE_BOAS           // Recursively the top half of the levels and then every bottom subtree
+    };
+
+    // Hot data, indexed by node
+    std::vector<AABB> bounds;           // Bounds of the objects below the node
+    std::vector<int> firstChild;        // Children firstChild .. firstChild + 3, -1 for the leaves
+    std::vector<glm::vec2> split;       // Center of the region of the node on the xz plane
+    std::vector<unsigned int> state;    // Visible flag (top bit) and frame of the last visit (31 bits)
+
+    // Cold data, indexed by node
+    std::vector<int> parents;
+    std::vector<glm::ivec2> objectRange;    // Objects [x, y) of Quadtree::objects below the node
+
+    std::vector<int> objects;       // Object ids grouped by leaf, in leaf order
+
+    // Full quadtree subdividing the bounds of the objects on the xz plane, each object goes to the leaf
+    // containing its center. The depth is chosen for about one object per leaf, some nodes may be empty
+    void build(const std::vector<AABB> &objectBounds, unsigned int currentFrame, Layout layout = DEPTH_FIRST);
+
+    // Bottom up update of the bounds of the leaves of the moved objects and of their ancestors,
+    // the objects stay in their leaves and the visibility state of the nodes is kept
+    void refit(const std::vector<AABB> &objectBounds, const std::vector<int> &movedObjects);
+    void refitAll(const std::vector<AABB> &objectBounds);
+
+    // Surface area heuristic cost relative to the area of the root, kept up to date by the refits
+    float getCost() const;
+    float getBuildCost() const {return buildCost;}
+
+    // Children of a node in front to back order from the viewpoint, returns their number
+    int childrenFrontToBack(QuadtreeNodeIndex i, const glm::vec3 &viewpoint, QuadtreeNodeIndex children[4]) const;
+
+    int getDepth() const {return depth;}
+    int getMaxLeafObjects() const {return maxLeafObjects;}
+    Layout getLayout() const {return layout;}
+
+    std::size_t size() const
+    {
+        return bounds.size();
+    }
+
     QuadtreeNodeIndex root()
     {
         return 0;
@@ -26,7 +69,7 @@ struct Quadtree
 
     QuadtreeNodeIndex parent(QuadtreeNodeIndex i)
     {
-        return (i-1)/4;
+        return parents[i];
     }
 
     bool hasParent(QuadtreeNodeIndex i)
@@ -36,7 +79,46 @@ struct Quadtree
 
     bool isLeaf(QuadtreeNodeIndex i)
     {
-        QuadtreeNodeIndex child = 4 * i + 1;
-        return child >= nodes.size();
+        return firstChild[i] < 0;
+    }
+
+    bool isEmpty(QuadtreeNodeIndex i)
+    {
+        return objectRange[i].x == objectRange[i].y;
     }
+
+    int numObjects(QuadtreeNodeIndex i)
+    {
+        return objectRange[i].y - objectRange[i].x;
+    }
+
+    const AABB &getAABB(QuadtreeNodeIndex i) const {return bounds[i];}
+    int getFirstObject(QuadtreeNodeIndex i) const {return objectRange[i].x;}
+    int getLastObject(QuadtreeNodeIndex i) const {return objectRange[i].y;}
+
+    // The frame stamps keep 31 bits, comparisons against a frame use the same bits
+    bool isVisible(QuadtreeNodeIndex i) const {return state[i] & VISIBLE;}
+    bool isVisibleInFrame(QuadtreeNodeIndex i, unsigned int frame) const {return state[i] == (VISIBLE | (frame & ~VISIBLE));}
+    void setVisible(QuadtreeNodeIndex i, bool visible) {state[i] = visible ? state[i] | VISIBLE : state[i] & ~VISIBLE;}
+    void setState(QuadtreeNodeIndex i, bool visible, unsigned int frame) {state[i] = (visible ? VISIBLE : 0) | (frame & ~VISIBLE);}
+
+private:
+    static const unsigned int VISIBLE = 1u << 31;
+
+    void buildRegions(QuadtreeNodeIndex nodeIndex, const glm::vec2 &regionMin, const glm::vec2 &regionMax);
+    void applyLayout(Layout layout);
+    double nodeCost(QuadtreeNodeIndex i);
+    void refitNode(const std::vector<AABB> &objectBounds, QuadtreeNodeIndex i);
+
+private:
+    int depth;
+    int maxLeafObjects;
+    Layout layout;
+    std::vector<int> objectLeaf;
+    std::vector<unsigned char> dirty;
+    std::vector<int> dirtyNodes;
+    double weightedArea;
+    float buildCost;
 };
+
+#endif // _QUADTREE_INCLUDE
@@ -4,7 +4,7 @@ QueryPool::QueryPool(int n)
     : ids(n)
     , i(0)
 {
-    glGenQueries(ids.size(), ids.data());
+    if (!ids.empty()) glGenQueries(ids.size(), ids.data());
 }
 
 QueryPool::QueryPool()
@@ -13,7 +13,7 @@ QueryPool::QueryPool()
 
 QueryPool::~QueryPool()
 {
-    glDeleteQueries(ids.size(), ids.data());
+    if (!ids.empty()) glDeleteQueries(ids.size(), ids.data());
 }
 
 // TODO: Check that i is in range (?)
@@ -25,4 +25,12 @@ Query QueryPool::getQuery()
 void QueryPool::clear()
 {
     i = 0;
+}
+
+void QueryPool::reserve(int n)
+{
+    int previousSize = ids.size();
+    if (n <= previousSize) return;
+    ids.resize(n);
+    glGenQueries(n - previousSize, ids.data() + previousSize);
 }
\ No newline at end of file
@@ -13,6 +13,16 @@ public:
     ~QueryPool();
     Query getQuery();
     void clear();
+
+    // Grows the pool to have at least n queries, the ones already generated are kept
+    void reserve(int n);
+    int size() const {return ids.size();}
+
+private:
+    // The pool owns the queries
+    QueryPool(const QueryPool &) = delete;
+    QueryPool &operator=(const QueryPool &) = delete;
+
 private:
     std::vector<GLuint> ids;
     int i;
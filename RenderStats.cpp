@@ -0,0 +1,48 @@
+#include "RenderStats.h"
+
+void VisibilityAccuracy::clear()
+{
+    visible = -1;
+    falsePositives = -1;
+    falseNegatives = -1;
+}
+
+void RenderStats::clear()
+{
+    rendered = 0;
+    drawCalls = 0;
+    meshTriangles = 0;
+    proxyTriangles = 0;
+    queriesIssued = 0;
+    queriesReady = 0;
+    queriesBlocked = 0;
+    blockedTime = 0.0f;
+    nodesTraversed = 0;
+    nodesFrustumCulled = 0;
+    meshletsCulled = 0;
+    validation.clear();
+    for (PerfCounts &counts : perf) counts.clear();
+}
+
+void RenderStats::writeHeader(std::ostream &out)
+{
+    out << "rendered draw_calls mesh_triangles proxy_triangles"
+        << " queries_issued queries_ready queries_blocked blocked_ms"
+        << " nodes_traversed nodes_frustum_culled meshlets_culled"
+        << " visible false_positives false_negatives";
+    for (int i = 0; i < NUM_PERF_PHASES; ++i) {
+        const char *name = PerfCounters::phaseName(static_cast<PerfPhase>(i));
+        out << ' ' << name << "_cycles " << name << "_instructions "
+            << name << "_cache_misses " << name << "_branch_misses";
+    }
+}
+
+void RenderStats::write(std::ostream &out) const
+{
+    out << rendered << ' ' << drawCalls << ' ' << meshTriangles << ' ' << proxyTriangles
+        << ' ' << queriesIssued << ' ' << queriesReady << ' ' << queriesBlocked << ' ' << blockedTime
+        << ' ' << nodesTraversed << ' ' << nodesFrustumCulled << ' ' << meshletsCulled
+        << ' ' << validation.visible << ' ' << validation.falsePositives << ' ' << validation.falseNegatives;
+    for (const PerfCounts &counts : perf)
+        out << ' ' << counts.cycles << ' ' << counts.instructions << ' ' << counts.cacheMisses << ' ' << counts.branchMisses;
+}
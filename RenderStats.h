@@ -0,0 +1,48 @@
+#ifndef _RENDER_STATS_INCLUDE
+#define _RENDER_STATS_INCLUDE
+
+#include "PerfCounters.h"
+
+#include <ostream>
+
+// Comparison of the objects drawn in a frame against the exact visible set
+// False positives are drawn but not visible, false negatives visible but not drawn
+struct VisibilityAccuracy
+{
+    int visible;               // -1 when the frame has not been validated
+    int falsePositives;
+    int falseNegatives;
+
+    void clear();
+};
+
+// RenderStats gathers the counters of a single frame, every rendering strategy fills them
+// For the strategies without a hierarchy every object counts as a traversed node
+struct RenderStats
+{
+    int rendered;              // Object copies rendered with their full mesh
+    int drawCalls;
+    long long meshTriangles;   // Triangles drawn from object meshes
+    long long proxyTriangles;  // Triangles drawn from bounding boxes (queries and debug)
+    int queriesIssued;
+    int queriesReady;          // Query results that were available when read
+    int queriesBlocked;        // Query results that stalled the CPU when read
+    float blockedTime;         // Time spent waiting for query results (ms)
+    int nodesTraversed;
+    int nodesFrustumCulled;
+    int meshletsCulled;        // Outside the frustum or facing away, with meshlet culling
+
+    // Accuracy of the previous frame, ground truth is read back one frame late
+    VisibilityAccuracy validation;
+
+    // Hardware counters of the phases of the frame (zero when not available)
+    PerfCounts perf[NUM_PERF_PHASES];
+
+    void clear();
+
+    // Plain text columns (gnuplot friendly)
+    static void writeHeader(std::ostream &out);
+    void write(std::ostream &out) const;
+};
+
+#endif // _RENDER_STATS_INCLUDE
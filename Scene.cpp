@@ -1,6 +1,8 @@
 #include "Scene.h"
+#include "AllocationCounter.h"
+#include "Culling.h"
 #include "Query.h"
-#include "PLYReader.h"
+#include "SceneDescription.h"
 
 #include "imgui.h"
 
@@ -8,10 +10,34 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/matrix_inverse.hpp>
-#include <glm/gtx/hash.hpp>
 
 #include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <limits>
+
+// Every MOVING_STRIDE-th object moves along a circle when the animation is enabled
+static const int MOVING_STRIDE = 4;
+static const float ANGULAR_SPEED = 0.02f;       // Radians per frame
+static const float MOTION_RADIUS = 1.5f;        // In sizes of the object
+
+// Objects per job of the parallel loops over the objects
+static const int OBJECTS_PER_JOB = 1024;
+
+// The hierarchies are rebuilt when the refits make them this much more expensive than when built
+static const float REBUILD_COST_RATIO = 1.3f;
+
+// Model of the unit cube that fills the box
+static glm::mat4 boxModel(const AABB &aabb)
+{
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, (aabb.max + aabb.min) / 2.0f);
+    model = glm::scale(model, aabb.max - aabb.min);
+    return model;
+}
+
 
 Scene::Scene()
 {
@@ -21,115 +47,335 @@ Scene::Scene()
 
 Scene::~Scene()
 {
-
+    finishPrepare();
+    meshes.clear(); // Before the manager that owns them is destroyed
 }
 
 
 void Scene::init()
 {
-    n = 16;
     frustumCulling = false;
     occlusionCulling = false;
     debugMode = false;
     pathMode = false;
+    validationMode = false;
+    perfCountersEnabled = false;
+    animate = false;
+    pipelined = false;
+    meshletCulling = false;
+    submitIndex = 0;
+    objectsVersion = 0;
+    frames[0].occlusionCulling = frames[1].occlusionCulling = -1;
+    rebuilds = 0;
     currentFrame = 0;
+    stats.clear();
+
+    // Until the first resize, the viewport the window was created with
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    viewportWidth = viewport[2];
+    viewportHeight = viewport[3];
 
     initShaders();
+    geometry.init(basicProgram);
+    if (GLEW_ARB_multi_draw_indirect)
+        meshletCommands.init(GL_DRAW_INDIRECT_BUFFER, MESHLET_COMMANDS_REGION_SIZE);
 
     camera.init();
-    loadMesh("../models/bunny.ply");
     cube.buildCube();
-    cube.sendToOpenGL(basicProgram);
+    cube.sendToOpenGL(geometry);
+    cube.releaseCPUData();
     floor.buildQuad();
-    floor.sendToOpenGL(basicProgram);
+    floor.sendToOpenGL(geometry);
+    floor.releaseCPUData();
+    sceneFileInput[0] = '\0';
+
+    hierarchyType = QUADTREE;
+    quadtreeLayout = Quadtree::DEPTH_FIRST;
+    lastOcclusionCulling = occlusionCulling;
+    lastHierarchyType = hierarchyType;
+    n = 16;
+    gridSizeInput = n;
+    meshManager.init(&jobSystem);
+    loadMesh("../models/bunny.ply");
+}
+
+
+// Copies of the grid mesh at (i, 0, -j), object i * n + j
+void Scene::setGridSize(int gridSize)
+{
+    // Coming from a scene file, its mesh table is replaced by the grid mesh
+    if (n == 0) {
+        gridSizeInput = gridSize;
+        loadMesh(gridMeshFile.c_str());
+        return;
+    }
+
+    n = std::clamp(gridSize, 1, int(MAX_GRID_SIZE));
+    gridSizeInput = n;
+
+    if (meshes.size() != 1) return; // The grid mesh could not be loaded
+    const AABB &meshAABB = meshes[0]->aabb;
+    instances.resize(n*n);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            Instance &instance = instances[i * n + j];
+            instance.mesh = 0;
+            instance.model = glm::translate(glm::mat4(1.0f), glm::vec3(i, 0, -j));
+            instance.color = glm::vec4(0.9f, 0.9f, 0.95f, 1.0f);
+            instance.aabb = transformAABB(meshAABB, instance.model);
+        }
+    }
+
+    // The floor covers the cells of the grid
+    AABB floorBounds;
+    floorBounds.min = glm::vec3(-0.5f, -0.5f, -n + 0.5f);
+    floorBounds.max = glm::vec3(n - 0.5f, -0.5f, 0.5f);
+    buildObjects(floorBounds);
+    traversalOrder.init(n);
+}
+
+
+bool Scene::loadScene(const std::string &filename)
+{
+    SceneDescription description;
+    if (!description.load(filename)) return false;
+
+    // The meshes of both tables are shared, the previous ones are released once replaced
+    std::vector<std::shared_ptr<TriangleMesh>> previousMeshes = std::move(meshes);
+    meshes.clear();
+    for (const std::string &meshFile : description.meshes) {
+        if (addMesh(meshFile) == -1) {
+            meshes = std::move(previousMeshes);
+            return false;
+        }
+    }
+
+    n = 0;
+    instances.resize(description.instances.size());
+    for (std::size_t i = 0; i < instances.size(); ++i) {
+        const InstanceDescription &instanceDescription = description.instances[i];
+        Instance &instance = instances[i];
+        instance.mesh = instanceDescription.mesh;
+        instance.model = instanceDescription.model();
+        instance.color = instanceDescription.color;
+        instance.aabb = transformAABB(meshes[instance.mesh]->aabb, instance.model);
+    }
+
+    // The floor lies under all the objects
+    AABB floorBounds = instances[0].aabb;
+    for (const Instance &instance : instances) {
+        floorBounds.min = glm::min(floorBounds.min, instance.aabb.min);
+        floorBounds.max = glm::max(floorBounds.max, instance.aabb.max);
+    }
+    floorBounds.max.y = floorBounds.min.y;
+    buildObjects(floorBounds);
+    std::cout << "Loaded scene " << filename << " with " << meshes.size() << " meshes and " << instances.size() << " instances" << std::endl;
+    return true;
+}
+
+
+// Everything that depends on the objects is rebuilt
+void Scene::buildObjects(const AABB &floorBounds)
+{
+    glm::vec3 floorCenter = (floorBounds.min + floorBounds.max) / 2.0f;
+    float floorSize = std::max(floorBounds.max.x - floorBounds.min.x, floorBounds.max.z - floorBounds.min.z);
     floorModel = glm::mat4(1.0f);
-    floorModel = glm::translate(floorModel, glm::vec3(n/2 - 0.5, -0.5f, -n/2 + 0.5));
+    floorModel = glm::translate(floorModel, floorCenter);
     floorModel = glm::rotate(floorModel, glm::half_pi<float>(), glm::vec3(1.0f, 0.0f, 0.0f));
-    floorModel = glm::scale(floorModel, glm::vec3(n));
+    floorModel = glm::scale(floorModel, glm::vec3(floorSize));
+
+    movingObjects.clear();
+    restModels.clear();
+    for (int i = 0; i < numObjects(); i += MOVING_STRIDE) {
+        movingObjects.push_back(i);
+        restModels.push_back(instances[i].model);
+    }
 
-    maxDepth = 4; // maxDepth = floor(log_2(n))
     buildSceneHierarchy();
+    oracle.init(basicProgram, numObjects());
+    distanceSorter.reserve(numObjects());
+
+    // Stamps start at a frame that is never the previous one
+    const unsigned int never = std::numeric_limits<unsigned int>::max();
+    renderedFrame.assign(numObjects(), never);
+    PVS.resize(numObjects());
+    nextPVS.resize(numObjects());
+    pvsFrame = 0;
+    previousFrameQueries.clear();
+    previousFrameQueries.reserve(numObjects());
+    for (FrameData &frame : frames) {
+        frame.drawList.reserve(numObjects());
+        frame.inside.reserve(numObjects());
+        frame.distances.reserve(numObjects());
+    }
+    ++objectsVersion;
+    warmupFrames = 2;
 }
 
 
 void Scene::buildSceneHierarchy()
 {
-    // Number of nodes of a full quadtree with maxDepth
-    int numNodes = (std::pow(4, maxDepth + 1) - 1)/ 3;
-    sceneHierarchy.nodes = std::vector<QuadtreeNode>(numNodes);
-    queryPool = QueryPool(numNodes);
+    if (rebuild.valid()) rebuild.get(); // Built from objects that may no longer exist
+
+    objectBounds.resize(numObjects());
+    for (int i = 0; i < numObjects(); ++i) objectBounds[i] = instances[i].aabb;
+    sceneHierarchy.build(objectBounds, currentFrame, Quadtree::Layout(quadtreeLayout));
+    bvh.build(objectBounds, currentFrame, &jobSystem);
+
+    // The advanced strategy issues a query per object and CHC one per node at most
+    int maxQueries = std::max(sceneHierarchy.size(), bvh.size());
+    queryPool.reserve(std::max(numObjects(), maxQueries));
     queryPool.clear();
+}
 
-    // Compute the bounding box of the root node
-    QuadtreeNodeIndex rootIndex = sceneHierarchy.root();
-    QuadtreeNode &root = sceneHierarchy.nodes[rootIndex];
 
-    root.aabb.min = glm::vec3(0.0f, mesh.aabb.min.y, 0.0f);
-    root.aabb.min += glm::vec3(-0.5f, 0.0f, 0.5f);
-    root.aabb.max = glm::vec3(n, mesh.aabb.max.y, -n);
-    root.aabb.max += glm::vec3(-0.5f, 0.0f, 0.5f);
+// Moves the animated objects and refits the hierarchies along the paths to their leaves
+void Scene::updateDynamicObjects()
+{
+    finishRebuild();
+    if (!animate) return;
+
+    for (std::size_t k = 0; k < movingObjects.size(); ++k) {
+        int object = movingObjects[k];
+        Instance &instance = instances[object];
+        glm::vec3 size = instance.aabb.max - instance.aabb.min;
+        float radius = MOTION_RADIUS * std::max(size.x, size.z);
+        float angle = ANGULAR_SPEED * currentFrame + object;
+        glm::vec3 offset(radius * std::cos(angle), 0.0f, radius * std::sin(angle));
+        instance.model = glm::translate(glm::mat4(1.0f), offset) * restModels[k];
+        instance.aabb = transformAABB(meshes[instance.mesh]->aabb, instance.model);
+        objectBounds[object] = instance.aabb;
+    }
+    sceneHierarchy.refit(objectBounds, movingObjects);
+    bvh.refit(objectBounds, movingObjects);
 
-    // Recursive function that builds the rest of the hierarchy
-    buildSceneHierarchy(rootIndex);
+    if (!rebuild.valid() && hierarchyCostRatio() > REBUILD_COST_RATIO) startRebuild();
 }
 
 
-void Scene::buildSceneHierarchy(QuadtreeNodeIndex nodeIndex)
+float Scene::hierarchyCostRatio() const
 {
-    QuadtreeNode &node = sceneHierarchy.nodes[nodeIndex];
-    node.visible = true;
-    node.lastVisited = currentFrame;
+    float cost = (hierarchyType == BVH) ? bvh.getCost() : sceneHierarchy.getCost();
+    float buildCost = (hierarchyType == BVH) ? bvh.getBuildCost() : sceneHierarchy.getBuildCost();
+    return buildCost > 0.0f ? cost / buildCost : 1.0f;
+}
 
-    glm::vec2 aabbMin(node.aabb.min.x, node.aabb.min.z);
-    glm::vec2 aabbMax(node.aabb.max.x, node.aabb.max.z);
-    glm::vec2 aabbCenter = (aabbMin + aabbMax) / 2.0f;
 
-    if (!sceneHierarchy.isLeaf(nodeIndex)) {
-        float minY = node.aabb.min.y;
-        float maxY = node.aabb.max.y;
+// Both hierarchies are built in another thread from a copy of the bounds, the refits go on meanwhile
+void Scene::startRebuild()
+{
+    rebuildBounds = objectBounds;
+    Quadtree::Layout layout = Quadtree::Layout(quadtreeLayout);
+    rebuild = std::async(std::launch::async, [this, layout]() {
+        nextSceneHierarchy.build(rebuildBounds, 0, layout);
+        nextBvh.build(rebuildBounds, 0, &jobSystem);
+    });
+}
 
-        QuadtreeNodeIndex blChildIndex = 4 * nodeIndex + 1;
-        QuadtreeNode &blChild = sceneHierarchy.nodes[blChildIndex];
-        blChild.aabb.min = glm::vec3(aabbMin.x, minY, aabbMin.y);
-        blChild.aabb.max = glm::vec3(aabbCenter.x, maxY, aabbCenter.y);
 
-        QuadtreeNodeIndex brChildIndex = 4 * nodeIndex + 2;
-        QuadtreeNode &brChild = sceneHierarchy.nodes[brChildIndex];
-        brChild.aabb.min = glm::vec3(aabbCenter.x, minY, aabbMin.y);
-        brChild.aabb.max = glm::vec3(aabbMax.x, maxY, aabbCenter.y);
-        
-        QuadtreeNodeIndex tlChildIndex = 4 * nodeIndex + 3;
-        QuadtreeNode &tlChild = sceneHierarchy.nodes[tlChildIndex];
-        tlChild.aabb.min = glm::vec3(aabbMin.x, minY, aabbCenter.y);
-        tlChild.aabb.max = glm::vec3(aabbCenter.x, maxY, aabbMax.y);
-        
-        QuadtreeNodeIndex trChildIndex = 4 * nodeIndex + 4;
-        QuadtreeNode &trChild = sceneHierarchy.nodes[trChildIndex];
-        trChild.aabb.min = glm::vec3(aabbCenter.x, minY, aabbCenter.y);
-        trChild.aabb.max = glm::vec3(aabbMax.x, maxY, aabbMax.y);
+void Scene::finishRebuild()
+{
+    if (!rebuild.valid()) return;
+    if (rebuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+    rebuild.get();
+
+    // The old hierarchies keep their memory for the next rebuild
+    std::swap(sceneHierarchy, nextSceneHierarchy);
+    std::swap(bvh, nextBvh);
+
+    // The objects kept moving while the hierarchies were built
+    sceneHierarchy.refitAll(objectBounds);
+    bvh.refitAll(objectBounds);
+    seedVisibility(sceneHierarchy);
+    seedVisibility(bvh);
+
+    int maxQueries = std::max(sceneHierarchy.size(), bvh.size());
+    queryPool.reserve(std::max(numObjects(), maxQueries));
+    warmupFrames = 2;
+    ++rebuilds;
+}
 
-        buildSceneHierarchy(blChildIndex);
-        buildSceneHierarchy(brChildIndex);
-        buildSceneHierarchy(tlChildIndex);
-        buildSceneHierarchy(trChildIndex);
-    }
-    else {
-        node.gridPosition = glm::ivec2(aabbCenter.x, -aabbCenter.y);
+
+// New nodes are visible in the previous frame when any of their objects was rendered in it,
+// so CHC keeps its temporal coherence across rebuilds
+template <typename Hierarchy>
+void Scene::seedVisibility(Hierarchy &hierarchy)
+{
+    unsigned int previousFrame = currentFrame - 1;
+    for (NodeIndex i = 0; i < hierarchy.size(); ++i) hierarchy.setState(i, false, previousFrame);
+    for (NodeIndex i = 0; i < hierarchy.size(); ++i) {
+        if (!hierarchy.isLeaf(i)) continue;
+        int last = hierarchy.getLastObject(i);
+        for (int k = hierarchy.getFirstObject(i); k < last; ++k) {
+            if (renderedFrame[hierarchy.objects[k]] != previousFrame) continue;
+            pullUpVisibility(hierarchy, i);
+            break;
+        }
     }
 }
 
 
+void Scene::setQuadtreeLayout(int layout)
+{
+    quadtreeLayout = layout;
+    buildSceneHierarchy();
+}
+
+
+// Mesh copied in the grid
 bool Scene::loadMesh(const char *filename)
 {
-    bool bSuccess = PLYReader::readMesh(filename, mesh);
-    if (bSuccess) {
-        mesh.sendToOpenGL(basicProgram);
-        std::cout << "Mesh bounding box" << std::endl;
-        std::cout << "min = (" << mesh.aabb.min.x << ", " << mesh.aabb.min.y << ", " << mesh.aabb.min.z << ")" << std::endl;
-        std::cout << "max = (" << mesh.aabb.max.x << ", " << mesh.aabb.max.y << ", " << mesh.aabb.max.z << ")" << std::endl;
+    std::vector<std::shared_ptr<TriangleMesh>> previousMeshes = std::move(meshes);
+    meshes.clear();
+    if (addMesh(filename) == -1) {
+        meshes = std::move(previousMeshes);
+        return false;
+    }
+    gridMeshFile = filename;
+    if (n == 0) n = gridSizeInput;
+    setGridSize(n);
+    return true;
+}
+
+
+// Adds the mesh of the file to the mesh table, loaded in the background the first time,
+// returns its index or -1 if the file can't be read
+// Until the mesh is loaded its instances are drawn as its bounding box, as they are if it fails to parse,
+// which the Settings tab reports
+int Scene::addMesh(const std::string &filename)
+{
+    std::shared_ptr<TriangleMesh> mesh = meshManager.acquire(filename);
+    if (!mesh) return -1;
+    meshes.push_back(std::move(mesh));
+    return meshes.size() - 1;
+}
+
+
+// The instances of the meshes loaded since the last frame take their real bounds
+void Scene::updateLoadedMeshes()
+{
+    std::vector<TriangleMesh *> loaded;
+    meshManager.update(geometry, loaded);
+    if (loaded.empty()) return;
+
+    for (int i = 0; i < numObjects(); ++i) {
+        Instance &instance = instances[i];
+        const TriangleMesh *mesh = meshes[instance.mesh].get();
+        if (std::find(loaded.begin(), loaded.end(), mesh) == loaded.end()) continue;
+        instance.aabb = transformAABB(mesh->aabb, instance.model);
+        objectBounds[i] = instance.aabb;
+    }
+    for (const TriangleMesh *mesh : loaded) {
+        std::size_t numMeshlets = mesh->getMeshlets().size();
+        if (numMeshlets <= meshletVisible.size()) continue;
+        meshletVisible.resize(numMeshlets);
+        meshletFirst.resize(numMeshlets);
+        meshletCount.resize(numMeshlets);
     }
-    else std::cout << "Couldn't load mesh " << filename << std::endl;
-    return bSuccess;
+    sceneHierarchy.refitAll(objectBounds);
+    bvh.refitAll(objectBounds);
+    ++objectsVersion;
 }
 
 
@@ -141,10 +387,50 @@ void Scene::update(int deltaTime)
 
 int Scene::render()
 {
+    // Nothing can change the objects or the hierarchies while the next frame is being prepared
+    finishPrepare();
+
     if (ImGui::Begin("Settings")) {
         ImGui::Checkbox("Enable/Disable Frustum Culling", &frustumCulling);
         ImGui::Checkbox("Enable/Disable Path Recording Mode", &pathMode);
         ImGui::Checkbox("Enable/Disable Debug Mode", &debugMode);
+        bool validation = validationMode;
+        if (ImGui::Checkbox("Enable/Disable Validation Mode", &validation))
+            setValidationMode(validation);
+        ImGui::Checkbox("Enable/Disable Animation", &animate);
+        ImGui::Checkbox("Enable/Disable Pipelining", &pipelined);
+        ImGui::Checkbox("Enable/Disable Meshlet Culling", &meshletCulling);
+        if (ImGui::Checkbox("Enable/Disable Hardware Counters", &perfCountersEnabled))
+            setPerfCounters(perfCountersEnabled);
+        ImGui::Separator();
+        if (ImGui::InputInt("Grid Size", &gridSizeInput, 1, 16, ImGuiInputTextFlags_EnterReturnsTrue))
+            setGridSize(gridSizeInput);
+        ImGui::InputText("Scene File", sceneFileInput, IM_ARRAYSIZE(sceneFileInput));
+        if (ImGui::Button("Load Scene")) loadScene(sceneFileInput);
+        ImGui::Text("Hierarchy");
+        ImGui::RadioButton("Quadtree", &hierarchyType, QUADTREE);
+        ImGui::SameLine();
+        ImGui::RadioButton("BVH", &hierarchyType, BVH);
+        if (hierarchyType == QUADTREE) {
+            int layout = quadtreeLayout;
+            ImGui::RadioButton("Breadth First", &layout, Quadtree::BREADTH_FIRST);
+            ImGui::SameLine();
+            ImGui::RadioButton("Depth First", &layout, Quadtree::DEPTH_FIRST);
+            ImGui::SameLine();
+            ImGui::RadioButton("van Emde Boas", &layout, Quadtree::VAN_EMDE_BOAS);
+            if (layout != quadtreeLayout) setQuadtreeLayout(layout);
+        }
+        if (hierarchyType == BVH) ImGui::Text("%d objects, BVH depth %d, up to %d objects per leaf", numObjects(), bvh.getDepth(), bvh.getMaxLeafObjects());
+        else ImGui::Text("%d objects, quadtree depth %d, up to %d objects per leaf", numObjects(), sceneHierarchy.getDepth(), sceneHierarchy.getMaxLeafObjects());
+        ImGui::Text("Cost %.2f times the built hierarchy, %d rebuilds", hierarchyCostRatio(), rebuilds);
+        MeshMemory memory = meshManager.getMemory();
+        ImGui::Text("%d meshes, %.1f MB CPU, %.1f MB GPU of %.1f MB", memory.meshes, memory.cpuBytes / 1048576.0,
+                    memory.gpuBytes / 1048576.0, geometry.getCapacityBytes() / 1048576.0);
+        if (meshManager.isLoading()) ImGui::Text("Loading meshes...");
+        if (meshletCommands.isMapped())
+            ImGui::Text("%d frames waited for their meshlet draw commands", meshletCommands.getStalls());
+        for (const std::string &failure : meshManager.getFailures())
+            ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Couldn't load %s", failure.c_str());
         ImGui::Separator();
         ImGui::Text("Occlusion Culling Strategy");
         ImGui::RadioButton("None", &occlusionCulling, NONE);
@@ -154,72 +440,330 @@ int Scene::render()
     }
     ImGui::End();
 
-    const glm::mat4 &view = camera.getViewMatrix();
-    const glm::mat4 &projection = camera.getProjectionMatrix();
+    ++currentFrame;
+    stats.clear();
+    perfCounters.beginFrame();
+    frameArena.reset();
+    // The UI draws with vertex arrays of its own between frames
+    geometry.resetBinding();
+    meshletCommands.beginFrame();
+    updateLoadedMeshes();
+    updateDynamicObjects();
+
+    long long allocationsBefore = heapAllocations();
+    const FrameData &frame = prepareStage();
+    long long prepareAllocations = heapAllocations() - allocationsBefore;
+    frameCamera = frame.camera;
+    if (validationMode) renderGroundTruth();
+
     basicProgram.use();
-    basicProgram.setUniformMatrix4f("view", view);
-    basicProgram.setUniformMatrix4f("projection", projection);
+    basicProgram.setUniformMatrix4f("view", frameCamera.view);
+    basicProgram.setUniformMatrix4f("projection", frameCamera.projection);
     basicProgram.setUniform1i("bLighting", 1);
     basicProgram.setUniform4f("color", 0.9f, 0.9f, 0.95f, 1.0f);
 
-    ++currentFrame;
     renderFloor();
+    allocationsBefore = heapAllocations();
+    int rendered;
     switch(occlusionCulling) {
         case NONE:
-            return renderBasic();
+            rendered = renderBasic(frame);
+            break;
         case STOP_AND_WAIT:
-            return renderStopAndWait();
+            rendered = renderStopAndWait(frame);
+            break;
         case ADVANCED:
-            return renderAdvanced();
+            rendered = renderAdvanced(frame);
+            break;
         case CHC:
-            return renderCHC();
+            rendered = renderCHC();
+            break;
         default:
             std::cerr << "Unknown Occlusion Queries Algorithm" << std::endl;
+            meshletCommands.endFrame();
             return -1;
     }
+    meshletCommands.endFrame();
+    checkSteadyStateAllocations(prepareAllocations + heapAllocations() - allocationsBefore);
+
+    for (int i = 0; i < NUM_PERF_PHASES; ++i)
+        stats.perf[i] = perfCounters.getPhase(static_cast<PerfPhase>(i));
+    return rendered;
 }
 
 
-int Scene::renderBasic()
+// Frame to submit, with its visibility work done
+// Pipelined, it was prepared during the previous frame with the camera of then, and the next one is prepared
+// in a job while the GL thread submits this one. This costs a frame of latency and the moving objects are
+// culled with their bounds of the previous frame. The strategies that wait for the queries of the same frame
+// are always prepared right away
+const Scene::FrameData &Scene::prepareStage()
 {
-    int rendered = 0;
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < n; ++j) {
-            glm::ivec2 gridPosition(i, j);
-            if (!frustumCulling || insideFrustum(gridPosition)) {
-                render(gridPosition);
-                ++rendered;
+    bool pipelineFrame = pipelined && (occlusionCulling == NONE || occlusionCulling == ADVANCED);
+    FrameData &frame = frames[submitIndex];
+    if (!pipelineFrame || !isUpToDate(frame)) {
+        setUpFrame(frame);
+        prepareFrame(frame, perfCounters);
+    }
+    if (pipelineFrame) {
+        int next = 1 - submitIndex;
+        setUpFrame(frames[next]);
+        jobSystem.spawn(prepareJob, &Scene::prepareFrameJob, this, next, 0);
+        submitIndex = next;
+    }
+    return frame;
+}
+
+
+void Scene::setUpFrame(FrameData &frame)
+{
+    frame.camera = camera.getSnapshot();
+    frame.occlusionCulling = occlusionCulling;
+    frame.frustumCulling = frustumCulling;
+    frame.hierarchyType = hierarchyType;
+    frame.objectsVersion = objectsVersion;
+}
+
+
+// Whether a frame prepared earlier still matches the settings and the objects
+bool Scene::isUpToDate(const FrameData &frame) const
+{
+    return frame.occlusionCulling == occlusionCulling && frame.frustumCulling == frustumCulling &&
+           frame.hierarchyType == hierarchyType && frame.objectsVersion == objectsVersion;
+}
+
+
+// Frustum culling and, for the advanced strategy, front to back ordering of the objects of a frame
+// It neither calls GL nor touches the state of the strategies so that it can run in a job,
+// the counters are only measured on the GL thread
+void Scene::prepareFrame(FrameData &frame, PerfCounters &counters)
+{
+    frame.drawList.clear();
+    frame.nodesTraversed = 0;
+    frame.nodesFrustumCulled = 0;
+    if (frame.occlusionCulling == CHC) return; // Culls along its own traversal
+    if (frame.occlusionCulling == NONE && frame.frustumCulling && frame.hierarchyType == BVH) {
+        PerfScope scope(counters, PERF_FRUSTUM_CULLING);
+        prepareBvh(frame);
+        return;
+    }
+
+    // Frustum culling of every object in parallel over ranges of objects, without it every object is inside
+    frame.inside.assign(numObjects(), 1);
+    if (frame.frustumCulling) {
+        PerfScope scope(counters, PERF_FRUSTUM_CULLING);
+        const Frustum &frustum = frame.camera.frustum;
+        unsigned char *inside = frame.inside.data();
+        jobSystem.parallelFor(0, numObjects(), OBJECTS_PER_JOB, [&](int begin, int end) {
+            for (int object = begin; object < end; ++object)
+                inside[object] = ::insideFrustum(frustum, instances[object].aabb);
+        });
+    }
+
+    // The draw list is then built in order from the flags
+    // Front to back for the advanced strategy: on a grid the order is only regenerated when the camera
+    // changes of cell, other scenes sort by distance
+    if (frame.occlusionCulling != ADVANCED) {
+        for (int object = 0; object < numObjects(); ++object)
+            if (frame.inside[object]) frame.drawList.push_back(object);
+    }
+    else if (n > 0) {
+        const std::vector<int> *order;
+        {
+            PerfScope scope(counters, PERF_SORTING);
+            order = &traversalOrder.frontToBack(frame.camera.position);
+        }
+        for (int object : *order)
+            if (frame.inside[object]) frame.drawList.push_back(object);
+    }
+    else {
+        // Distances of every object in parallel, the ones outside of the frustum are dropped afterwards
+        std::vector<DistanceObject> &distances = frame.distances;
+        distances.resize(numObjects());
+        glm::vec3 viewpoint = frame.camera.position;
+        jobSystem.parallelFor(0, numObjects(), OBJECTS_PER_JOB, [&](int begin, int end) {
+            for (int object = begin; object < end; ++object) {
+                const AABB &aabb = instances[object].aabb;
+                distances[object] = DistanceObject(glm::distance(viewpoint, (aabb.min + aabb.max) / 2.0f), object);
             }
+        });
+        int numInside = 0;
+        for (int object = 0; object < numObjects(); ++object)
+            if (frame.inside[object]) distances[numInside++] = distances[object];
+        distances.resize(numInside);
+        {
+            PerfScope scope(counters, PERF_SORTING);
+            distanceSorter.sort(distances.data(), distances.data() + distances.size());
         }
+        for (const DistanceObject &distance : distances) frame.drawList.push_back(distance.second);
     }
-    return rendered;
+    frame.nodesTraversed = numObjects();
+    frame.nodesFrustumCulled = numObjects() - frame.drawList.size();
 }
 
 
-int Scene::renderStopAndWait()
+// Hierarchical frustum culling with a stackless traversal of the BVH,
+// a node outside of the frustum skips its whole subtree
+void Scene::prepareBvh(FrameData &frame)
 {
-    int rendered = 0;
+    const Frustum &frustum = frame.camera.frustum;
+    BvhNodeIndex i = 0;
+    while (i < bvh.nodes.size()) {
+        const BvhNode &node = bvh.nodes[i];
+        ++frame.nodesTraversed;
+        if (bvh.isEmpty(i) || !::insideFrustum(frustum, node.aabb)) {
+            ++frame.nodesFrustumCulled;
+            i = node.skip;
+        }
+        else if (bvh.isLeaf(i)) {
+            for (int k = node.firstObject; k < node.lastObject; ++k) {
+                int object = bvh.objects[k];
+                if (bvh.numObjects(i) > 1 && !::insideFrustum(frustum, instances[object].aabb)) continue;
+                frame.drawList.push_back(object);
+            }
+            i = node.skip;
+        }
+        else ++i;
+    }
+}
+
+
+void Scene::prepareFrameJob(void *scene, int index, int)
+{
+    Scene &self = *static_cast<Scene *>(scene);
+    self.prepareFrame(self.frames[index], self.unmeasured);
+}
+
+
+void Scene::finishPrepare()
+{
+    jobSystem.wait(prepareJob);
+}
+
+
+// Once the arena has grown to the needs of the strategy a frame must not touch the heap
+// Only checked in builds with COUNT_ALLOCATIONS (Debug)
+void Scene::checkSteadyStateAllocations(long long allocations)
+{
+    if (occlusionCulling != lastOcclusionCulling || hierarchyType != lastHierarchyType) {
+        lastOcclusionCulling = occlusionCulling;
+        lastHierarchyType = hierarchyType;
+        warmupFrames = 2;
+    }
+    if (warmupFrames > 0) {
+        --warmupFrames;
+        return;
+    }
+    if (allocations != 0) std::cerr << allocations << " heap allocations in frame " << currentFrame << std::endl;
+    assert(allocations == 0);
+}
+
+
+void Scene::setPerfCounters(bool enabled)
+{
+    perfCountersEnabled = enabled;
+    if (!enabled) perfCounters.close();
+    else if (!perfCounters.open()) {
+        std::cout << "Hardware performance counters are not available" << std::endl;
+        perfCountersEnabled = false;
+    }
+}
+
+
+// The frames read back before a pause are not compared with those drawn after it
+void Scene::setValidationMode(bool enabled)
+{
+    if (enabled != validationMode) oracle.dropReadbacks();
+    validationMode = enabled;
+}
+
+
+void Scene::resize(int width, int height)
+{
+    viewportWidth = width;
+    viewportHeight = height;
+    camera.resizeCameraViewport(width, height);
+}
+
+
+// Render every object without any culling into the id buffer of the oracle
+// and compare the previous frame ground truth with what was drawn on it
+void Scene::renderGroundTruth()
+{
+    if (viewportWidth == 0 || viewportHeight == 0) return;
+    oracle.resize(viewportWidth, viewportHeight);
+    oracle.begin(currentFrame, frameCamera.view, frameCamera.projection);
+    oracle.setOccluder(floorModel);
+    floor.render();
+    for (int i = 0; i < numObjects(); ++i) {
+        const Instance &instance = instances[i];
+        const TriangleMesh &mesh = *meshes[instance.mesh];
+        if (mesh.isResident()) {
+            oracle.setObject(i, instance.model);
+            mesh.render();
+        }
+        else {
+            oracle.setObject(i, boxModel(instance.aabb));
+            cube.render();
+        }
+    }
+    oracle.end();
+    oracle.resolve(stats.validation);
+}
+
+
+// Reads the result of a query, keeping track of whether the CPU had to wait for it
+bool Scene::isVisible(const Query &query)
+{
+    if (query.resultIsReady()) {
+        ++stats.queriesReady;
+        return query.isVisible();
+    }
+
+    ++stats.queriesBlocked;
+    auto start = std::chrono::steady_clock::now();
+    bool visible = query.isVisible();
+    auto end = std::chrono::steady_clock::now();
+    stats.blockedTime += std::chrono::duration<float, std::milli>(end - start).count();
+    return visible;
+}
+
+
+int Scene::renderBasic(const FrameData &frame)
+{
+    stats.nodesTraversed += frame.nodesTraversed;
+    stats.nodesFrustumCulled += frame.nodesFrustumCulled;
+    for (int object : frame.drawList) {
+        renderObject(object);
+        ++stats.rendered;
+    }
+    return stats.rendered;
+}
+
+
+int Scene::renderStopAndWait(const FrameData &frame)
+{
+    stats.nodesTraversed += frame.nodesTraversed;
+    stats.nodesFrustumCulled += frame.nodesFrustumCulled;
     queryPool.clear();
     Query query = queryPool.getQuery();
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < n; ++j) {
-            glm::ivec2 gridPosition(i, j);
-            if (frustumCulling && !insideFrustum(gridPosition)) continue;
-
-            query.begin();
-            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-            glDepthMask(GL_FALSE);
-            renderBoundingBox(gridPosition, false);
-            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-            glDepthMask(GL_TRUE);
-            query.end();
-            if (query.isVisible()) {
-                render(gridPosition);
-                ++rendered;
-            }
+    // Every object waits for its own query, the whole loop is polling
+    PerfScope scope(perfCounters, PERF_QUERY_POLLING);
+    for (int object : frame.drawList) {
+        ++stats.queriesIssued;
+        query.begin();
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        renderBoundingBox(instances[object].aabb, false);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        query.end();
+        if (isVisible(query)) {
+            renderObject(object);
+            ++stats.rendered;
         }
     }
-    return rendered;
+    return stats.rendered;
 }
 
 
@@ -227,108 +771,120 @@ int Scene::renderStopAndWait()
 // If object in PVS -> Render directly and issue query for next frame
 // If object not in PVS -> Do not render and issue query to be resolved later this frame
 // After all scene has been traverse, resolve the queries that were still pending for this frame
-int Scene::renderAdvanced()
+int Scene::renderAdvanced(const FrameData &frame)
 {
-    // Front to back ordering of the scene
-    std::vector<DistancePosition> E;
-    E.reserve(n*n);
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < n; ++j) {
-            glm::ivec2 gridPosition(i, j);
-            if (!frustumCulling || insideFrustum(gridPosition)) {
-                float d = distanceToCamera(gridPosition);
-                E.emplace_back(d, gridPosition);
-            }
-        }
+    // Front to back ordering of the objects inside of the frustum
+    const std::vector<int> &E = frame.drawList;
+    stats.nodesTraversed += frame.nodesTraversed;
+    stats.nodesFrustumCulled += frame.nodesFrustumCulled;
+
+    // The PVS and its pending queries are stale if the previous frame used another strategy
+    // (which has reused the queries)
+    if (pvsFrame + 1 != currentFrame) {
+        PVS.clear();
+        previousFrameQueries.clear();
     }
 
-    auto compareFunction = [](const DistancePosition &x, const DistancePosition &y) {return x.first < y.first; };
-    std::sort(E.begin(), E.end(), compareFunction);
-
     // Resolve visibility from previous frame
-    while (!previousFrameQueries.empty()) {
-        auto [query, gridPosition] = previousFrameQueries.front(); previousFrameQueries.pop();
-        if (query.isVisible()) PVS.insert(gridPosition);
+    {
+        PerfScope scope(perfCounters, PERF_QUERY_POLLING);
+        for (auto [query, object] : previousFrameQueries)
+            if (isVisible(query)) PVS.set(object);
     }
-
+    previousFrameQueries.clear();
     queryPool.clear();
-    int rendered = 0;
-    std::unordered_set<glm::ivec2> nextPVS;
 
     // Render front to back using visibility from previous frame
-    std::queue<QueryInfo> currentFrameQueries;
-    for (auto [d, gridPosition] : E) {
+    ArenaQueue<QueryInfo> currentFrameQueries(frameArena);
+    currentFrameQueries.reserve(E.size());
+    for (int object : E) {
 
         // Check first if any of the queries of this frame is already available
         // If the result is available, and the object is visible, then render it first
         // This can help to reduce the number of objects drawn since this acts a blocker
         if (!currentFrameQueries.empty()) {
-            auto [query, queryPosition] = currentFrameQueries.front();
+            auto [query, queryObject] = currentFrameQueries.front();
             while (query.resultIsReady()) {
                 currentFrameQueries.pop();
-                if (query.isVisible()) {
-                    render(queryPosition);
-                    nextPVS.insert(queryPosition);
-                    ++rendered;
+                if (isVisible(query)) {
+                    renderObject(queryObject);
+                    nextPVS.set(queryObject);
+                    ++stats.rendered;
                 }
                 if (currentFrameQueries.empty()) break;
                 else {
-                    auto [query_, queryPosition_] = currentFrameQueries.front();
+                    auto [query_, queryObject_] = currentFrameQueries.front();
                     query = query_;
-                    queryPosition = queryPosition_;
+                    queryObject = queryObject_;
                 }
             }    
         }
 
-        bool inV = (PVS.find(gridPosition) != PVS.end());
+        bool inV = PVS.test(object);
         if (inV) {
             Query query = queryPool.getQuery();
+            ++stats.queriesIssued;
             query.begin();
-            render(gridPosition);
+            renderObject(object);
             query.end();
-            ++rendered;
-            previousFrameQueries.emplace(query, gridPosition);
+            ++stats.rendered;
+            previousFrameQueries.emplace_back(query, object);
         }
         else { // !inV
             Query query = queryPool.getQuery();
+            ++stats.queriesIssued;
             query.begin();
             glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
             glDepthMask(GL_FALSE);
-            renderBoundingBox(gridPosition, false);
+            renderBoundingBox(instances[object].aabb, false);
             glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
             glDepthMask(GL_TRUE);
             query.end();
-            currentFrameQueries.emplace(query, gridPosition);
+            currentFrameQueries.emplace(query, object);
         }
     }
 
     // Resolve the visibility of this frame that is still unknown
+    PerfScope scope(perfCounters, PERF_QUERY_POLLING);
     while (!currentFrameQueries.empty()) {
-        auto [query, gridPosition] = currentFrameQueries.front(); currentFrameQueries.pop();
-        if (query.isVisible()) {
-            render(gridPosition);
-            nextPVS.insert(gridPosition);
-            ++rendered;
+        auto [query, object] = currentFrameQueries.front(); currentFrameQueries.pop();
+        if (isVisible(query)) {
+            renderObject(object);
+            nextPVS.set(object);
+            ++stats.rendered;
         }
     }
 
-    PVS = std::move(nextPVS);
-    return rendered;
+    PVS.swap(nextPVS);
+    nextPVS.clear();
+    pvsFrame = currentFrame;
+    return stats.rendered;
 }
 
 
-// CHC implementation as 
 int Scene::renderCHC()
 {
-    using QueryInfoCHC = std::pair<Query,QuadtreeNodeIndex>;
-    alreadyRendered = std::vector<std::vector<bool>> (n, std::vector<bool>(n, false));
+    if (hierarchyType == BVH) return renderCHC(bvh);
+    else return renderCHC(sceneHierarchy);
+}
 
-    std::stack<QuadtreeNodeIndex> nodes;
-    std::queue<QueryInfoCHC> queries;
-    int rendered = 0;
+
+// CHC implementation as 
+template <typename Hierarchy>
+int Scene::renderCHC(Hierarchy &hierarchy)
+{
+    using QueryInfoCHC = std::pair<Query,NodeIndex>;
+
+    // Every node is visited at most once per frame
+    ArenaVector<NodeIndex> nodes{ArenaAllocator<NodeIndex>(frameArena)};
+    ArenaQueue<QueryInfoCHC> queries(frameArena);
+    nodes.reserve(hierarchy.size());
+    queries.reserve(hierarchy.size());
     queryPool.clear();
 
-    nodes.push(sceneHierarchy.root());
+    // Polling and frustum culling are interleaved with the traversal node by node, the whole loop counts as it
+    PerfScope scope(perfCounters, PERF_HIERARCHY_TRAVERSAL);
+    nodes.push_back(hierarchy.root());
     while (!nodes.empty() || !queries.empty()) {
 
         // If there are queries with result available, empty all of them
@@ -337,12 +893,12 @@ int Scene::renderCHC()
             while (query.resultIsReady()) {
                 queries.pop();
 
-                if (query.isVisible()) {
-                    pullUpVisibility(nodeIndex);
+                if (isVisible(query)) {
+                    pullUpVisibility(hierarchy, nodeIndex);
 
-                    bool isLeaf = sceneHierarchy.isLeaf(nodeIndex);
-                    if (isLeaf) rendered += render(nodeIndex);
-                    else addChildren(nodeIndex, nodes);
+                    bool isLeaf = hierarchy.isLeaf(nodeIndex);
+                    if (isLeaf) stats.rendered += render(hierarchy, nodeIndex);
+                    else addChildren(hierarchy, nodeIndex, nodes);
                 }
 
                 if (queries.empty()) break;
@@ -355,86 +911,67 @@ int Scene::renderCHC()
 
         // Traverse the hierarchy of nodes using the previous frame visibility to render them
         if (!nodes.empty()) {
-            QuadtreeNodeIndex nodeIndex = nodes.top(); nodes.pop();
-            QuadtreeNode &node = sceneHierarchy.nodes[nodeIndex];
+            NodeIndex nodeIndex = nodes.back(); nodes.pop_back();
+            const AABB &aabb = hierarchy.getAABB(nodeIndex);
+            ++stats.nodesTraversed;
 
-            bool wasVisible = node.visible && (node.lastVisited == currentFrame - 1);
-            bool isLeaf = sceneHierarchy.isLeaf(nodeIndex);
+            bool wasVisible = hierarchy.isVisibleInFrame(nodeIndex, currentFrame - 1);
+            bool isLeaf = hierarchy.isLeaf(nodeIndex);
 
-            node.visible = false;
-            node.lastVisited = currentFrame;
+            hierarchy.setState(nodeIndex, false, currentFrame);
             
             // If node can be frustum culled there is nothing more to do
-            if (!frustumCulling || insideFrustum(node.aabb)) {
+            if (!frustumCulling || insideFrustum(aabb)) {
                 if (wasVisible) {
                     if (isLeaf) {
-                        Query query = renderWithQuery(nodeIndex);
+                        Query query = renderWithQuery(hierarchy, nodeIndex);
                         queries.emplace(query, nodeIndex);
-                        ++rendered;
                     }
-                    else addChildren(nodeIndex, nodes);
+                    else addChildren(hierarchy, nodeIndex, nodes);
                 }
                 else {
-                    Query query = issueQuery(nodeIndex);
+                    Query query = issueQuery(aabb);
                     queries.emplace(query, nodeIndex);
                 }
             }
+            else ++stats.nodesFrustumCulled;
         }
     }
-    return rendered;
+    return stats.rendered;
 }
 
 
 // Add the children of the node sorted by distance to the camera (front to back rendering)
-void Scene::addChildren(QuadtreeNodeIndex nodeIndex, std::stack<QuadtreeNodeIndex> &nodes)
+template <typename Hierarchy>
+void Scene::addChildren(Hierarchy &hierarchy, NodeIndex nodeIndex, ArenaVector<NodeIndex> &nodes)
 {
-    QuadtreeNodeIndex blChildIndex = 4 * nodeIndex + 1;
-    QuadtreeNodeIndex brChildIndex = 4 * nodeIndex + 2;
-    QuadtreeNodeIndex tlChildIndex = 4 * nodeIndex + 3;
-    QuadtreeNodeIndex trChildIndex = 4 * nodeIndex + 4;
-
-    QuadtreeNode &blChildNode = sceneHierarchy.nodes[blChildIndex];
-    QuadtreeNode &brChildNode = sceneHierarchy.nodes[brChildIndex];
-    QuadtreeNode &tlChildNode = sceneHierarchy.nodes[tlChildIndex];
-    QuadtreeNode &trChildNode = sceneHierarchy.nodes[trChildIndex];
-
-    std::vector<std::pair<float,QuadtreeNodeIndex>> v(4);
-    
-    v[0] = std::make_pair(distanceToCamera(blChildNode.gridPosition), blChildIndex);
-    v[1] = std::make_pair(distanceToCamera(brChildNode.gridPosition), brChildIndex);
-    v[2] = std::make_pair(distanceToCamera(tlChildNode.gridPosition), tlChildIndex);
-    v[3] = std::make_pair(distanceToCamera(trChildNode.gridPosition), trChildIndex);
-
-    std::sort(v.begin(), v.end());
-    for (int i = 3; i >= 0; --i)
-        nodes.push(v[i].second);
+    NodeIndex children[4];
+    int numChildren = hierarchy.childrenFrontToBack(nodeIndex, frameCamera.position, children);
+    for (int i = numChildren - 1; i >= 0; --i)
+        if (!hierarchy.isEmpty(children[i])) nodes.push_back(children[i]);
 }
 
 
-Query Scene::renderWithQuery(QuadtreeNodeIndex nodeIndex)
+template <typename Hierarchy>
+Query Scene::renderWithQuery(Hierarchy &hierarchy, NodeIndex nodeIndex)
 {
-    QuadtreeNode &node = sceneHierarchy.nodes[nodeIndex];
     Query query = queryPool.getQuery();
+    ++stats.queriesIssued;
     query.begin();
-    render(node.gridPosition);
+    stats.rendered += render(hierarchy, nodeIndex);
     query.end();
-    alreadyRendered[node.gridPosition.x][node.gridPosition.y] = true;
     return query;
 }
 
 
-Query Scene::issueQuery(QuadtreeNodeIndex nodeIndex)
+Query Scene::issueQuery(const AABB &aabb)
 {
-    bool isLeaf = sceneHierarchy.isLeaf(nodeIndex);
     Query query = queryPool.getQuery();
+    ++stats.queriesIssued;
     glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
     glDepthMask(GL_FALSE);
     query.begin();
-    if (isLeaf) {
-        QuadtreeNode &node = sceneHierarchy.nodes[nodeIndex];
-        renderBoundingBox(node.gridPosition, false);
-    }
-    else renderBoundingBox(nodeIndex, false);
+    renderBoundingBox(aabb, false);
     query.end();
     glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
     glDepthMask(GL_TRUE);
@@ -443,81 +980,114 @@ Query Scene::issueQuery(QuadtreeNodeIndex nodeIndex)
 
 
 // Set as visible the node and all of its ancestors
-void Scene::pullUpVisibility(QuadtreeNodeIndex nodeIndex)
+template <typename Hierarchy>
+void Scene::pullUpVisibility(Hierarchy &hierarchy, NodeIndex nodeIndex)
 {
-    QuadtreeNode &node = sceneHierarchy.nodes[nodeIndex];
-    if (!node.visible) {
-        node.visible = true;
-        if (sceneHierarchy.hasParent(nodeIndex)) pullUpVisibility(sceneHierarchy.parent(nodeIndex));
+    while (true) {
+        if (hierarchy.isVisible(nodeIndex)) return;
+        hierarchy.setVisible(nodeIndex, true);
+        if (!hierarchy.hasParent(nodeIndex)) return;
+        nodeIndex = hierarchy.parent(nodeIndex);
     }
 }
 
 
 // Render the scene hierarchy, for debugging purposes
-void Scene::renderSceneHierarchy(QuadtreeNodeIndex nodeIndex)
+template <typename Hierarchy>
+void Scene::renderSceneHierarchy(Hierarchy &hierarchy, NodeIndex nodeIndex)
 {
-    renderBoundingBox(nodeIndex, true);
-    if (!sceneHierarchy.isLeaf(nodeIndex)) {
-        renderSceneHierarchy(4 * nodeIndex + 1);
-        renderSceneHierarchy(4 * nodeIndex + 2);
-        renderSceneHierarchy(4 * nodeIndex + 3);
-        renderSceneHierarchy(4 * nodeIndex + 4);
+    if (hierarchy.isEmpty(nodeIndex)) return;
+    renderBoundingBox(hierarchy.getAABB(nodeIndex), true);
+    if (!hierarchy.isLeaf(nodeIndex)) {
+        NodeIndex children[4];
+        int numChildren = hierarchy.childrenFrontToBack(nodeIndex, frameCamera.position, children);
+        for (int i = 0; i < numChildren; ++i)
+            renderSceneHierarchy(hierarchy, children[i]);
     }
 }
 
 
-int Scene::render(QuadtreeNodeIndex nodeIndex)
+// Render the objects of a leaf that have not been rendered yet in this frame
+// Leaves with several objects also frustum cull them one by one
+template <typename Hierarchy>
+int Scene::render(Hierarchy &hierarchy, NodeIndex nodeIndex)
 {
-    QuadtreeNode &node = sceneHierarchy.nodes[nodeIndex];
-    if (alreadyRendered[node.gridPosition.x][node.gridPosition.y])
-        return 0;
-    else {
-        render(node.gridPosition);
-        alreadyRendered[node.gridPosition.x][node.gridPosition.y] = true;
-        return 1;
+    bool cullObjects = frustumCulling && hierarchy.numObjects(nodeIndex) > 1;
+    int rendered = 0;
+    int last = hierarchy.getLastObject(nodeIndex);
+    for (int i = hierarchy.getFirstObject(nodeIndex); i < last; ++i) {
+        int object = hierarchy.objects[i];
+        if (renderedFrame[object] == currentFrame) continue;
+        if (cullObjects && !insideFrustum(object)) continue;
+        renderObject(object);
+        renderedFrame[object] = currentFrame;
+        ++rendered;
     }
+    return rendered;
 }
 
 
-void Scene::render(const glm::ivec2 &gridPosition)
+void Scene::renderObject(int object)
 {
-    const glm::mat4 model = glm::translate(glm::mat4(1.0f), worldPosition(gridPosition));
-    const glm::mat4 &view = camera.getViewMatrix();
-    const glm::mat3 normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+    const Instance &instance = instances[object];
+    const TriangleMesh &mesh = *meshes[instance.mesh];
+    basicProgram.setUniform4f("color", instance.color.r, instance.color.g, instance.color.b, instance.color.a);
+
+    // Proxy of a mesh that is still loading
+    if (!mesh.isResident()) {
+        if (!pathMode) {
+            renderBoundingBox(instance.aabb, false);
+            if (validationMode) oracle.markDrawn(object);
+        }
+        if (debugMode || pathMode) renderBoundingBox(instance.aabb, true);
+        return;
+    }
 
-    basicProgram.setUniformMatrix4f("model", model);
+    const glm::mat4 &view = frameCamera.view;
+    const glm::mat3 normalMatrix = glm::mat3(glm::inverseTranspose(view * instance.model));
+    basicProgram.setUniformMatrix4f("model", instance.model);
     basicProgram.setUniformMatrix3f("normalMatrix", normalMatrix);
-    if (!pathMode) mesh.render();
-    if (debugMode || pathMode) renderBoundingBox(gridPosition, true);
-}
-
-
-void Scene::renderBoundingBox(QuadtreeNodeIndex nodeIndex, bool wireframe)
-{
-    const QuadtreeNode &node = sceneHierarchy.nodes[nodeIndex];
-    const AABB &aabb = node.aabb;
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, (aabb.max + aabb.min) / 2.0f);
-    model = glm::scale(model, aabb.max - aabb.min);
-
-    renderBoundingBox(model, wireframe);
+    if (!pathMode) {
+        const Meshlets &meshlets = mesh.getMeshlets();
+        if (meshletCulling && meshlets.size() > 0) {
+            int numTriangles, numCulled, numRanges;
+            std::size_t size = meshlets.size() * sizeof(DrawArraysCommand);
+            void *commands = meshletCommands.allocate(size, alignof(DrawArraysCommand));
+            if (commands) {
+                numRanges = meshlets.cull(instance.model, frameCamera, mesh.getFirstVertex(), meshletVisible.data(),
+                                          static_cast<DrawArraysCommand *>(commands), numTriangles, numCulled);
+                meshletCommands.shrink(commands, size, numRanges * sizeof(DrawArraysCommand));
+                if (numRanges > 0) mesh.render(meshletCommands.getOffset(commands), numRanges);
+            }
+            else {
+                numRanges = meshlets.cull(instance.model, frameCamera, mesh.getFirstVertex(), meshletVisible.data(),
+                                          meshletFirst.data(), meshletCount.data(), numTriangles, numCulled);
+                if (numRanges > 0) mesh.render(meshletFirst.data(), meshletCount.data(), numRanges);
+            }
+            if (numRanges > 0) ++stats.drawCalls;
+            stats.meshTriangles += numTriangles;
+            stats.meshletsCulled += numCulled;
+        }
+        else {
+            mesh.render();
+            ++stats.drawCalls;
+            stats.meshTriangles += mesh.getNumTriangles();
+        }
+        if (validationMode) oracle.markDrawn(object);
+    }
+    if (debugMode || pathMode) renderBoundingBox(instance.aabb, true);
 }
 
 
-void Scene::renderBoundingBox(const glm::ivec2 &gridPosition, bool wireframe)
+void Scene::renderBoundingBox(const AABB &aabb, bool wireframe)
 {
-    const AABB &aabb = mesh.aabb;
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, worldPosition(gridPosition));
-    model = glm::scale(model, aabb.max - aabb.min);
-
-    renderBoundingBox(model, wireframe);
+    renderBoundingBox(boxModel(aabb), wireframe);
 }
 
 
 void Scene::renderBoundingBox(const glm::mat4 &model, bool wireframe)
 {
-    const glm::mat4 &view = camera.getViewMatrix();
+    const glm::mat4 &view = frameCamera.view;
     const glm::mat3 normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 
     basicProgram.setUniformMatrix4f("model", model);
@@ -526,92 +1096,41 @@ void Scene::renderBoundingBox(const glm::mat4 &model, bool wireframe)
     if (wireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     cube.render();
     if (wireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    ++stats.drawCalls;
+    stats.proxyTriangles += cube.getNumTriangles();
 }
 
 
 void Scene::renderFloor()
 {
-    const glm::mat4 &view = camera.getViewMatrix();
+    const glm::mat4 &view = frameCamera.view;
     const glm::mat3 normalMatrix = glm::mat3(glm::inverseTranspose(view * floorModel));
     basicProgram.setUniformMatrix4f("model", floorModel);
     basicProgram.setUniformMatrix3f("normalMatrix", normalMatrix);
     floor.render();
+    ++stats.drawCalls;
 }
 
 
-bool Scene::insideFrustum(const glm::ivec2 &gridPosition) const
+bool Scene::insideFrustum(int object) const
 {
-    glm::mat4 model = glm::translate(glm::mat4(1.0f), worldPosition(gridPosition));
-    glm::vec3 aabbMin = model * glm::vec4(mesh.aabb.min, 1.0f);
-    glm::vec3 aabbMax = model * glm::vec4(mesh.aabb.max, 1.0f);
-    AABB aabb = {aabbMin, aabbMax};
-    return insideFrustum(aabb);    
+    return ::insideFrustum(frameCamera.frustum, instances[object].aabb);
 }
 
 
-// Simple conservative frustum culling implementation, all computations are made in world space
-// Checks for the existence of a frustum plane that leaves all vertices of the bounding box on the outside
-// Might return false positives
 bool Scene::insideFrustum(const AABB &aabb) const
 {
-    const Frustum &frustum = camera.getFrustum();
-    glm::vec4 aabbMin = glm::vec4(aabb.min, 1.0f);
-    glm::vec4 aabbIncrement = glm::vec4(aabb.max - aabb.min, 0.0f);
-
-    for (const glm::vec4 &frustumPlane : frustum.planes) {
-        bool allOutside = true;
-        for (int x = 0; x <= 1 && allOutside; ++x) {
-            for (int y = 0; y <= 1 && allOutside; ++y) {
-                for (int z = 0; z <= 1 && allOutside; ++z) {
-                    glm::vec4 aabbCorner = aabbMin + glm::vec4(x, y, z, 1.0f) * aabbIncrement;
-                    if (glm::dot(frustumPlane, aabbCorner) <= 0.0f) allOutside = false;
-                }
-            }
-        }
-        if (allOutside) return false;
-    }
-    return true;
-}
-
-
-glm::vec3 Scene::worldPosition(const glm::ivec2 &gridPosition)
-{
-    return glm::vec3(gridPosition.x, 0, -gridPosition.y);
-}
-
-
-float Scene::distanceToCamera(const glm::ivec2 &gridPosition)
-{
-    return glm::distance(camera.getPosition(), worldPosition(gridPosition));
+    return ::insideFrustum(frameCamera.frustum, aabb);
 }
 
 
 void Scene::initShaders()
 {
-    Shader vShader, fShader;
-
-    vShader.initFromFile(VERTEX_SHADER, "shaders/basic.vs");
-    if (!vShader.isCompiled())
-    {
-        std::cout << "Vertex Shader Error" << std::endl;
-        std::cout << "" << vShader.log() << std::endl << std::endl;
-    }
-    fShader.initFromFile(FRAGMENT_SHADER, "shaders/basic.fs");
-    if (!fShader.isCompiled())
-    {
-        std::cout << "Fragment Shader Error" << std::endl;
-        std::cout << "" << fShader.log() << std::endl << std::endl;
-    }
     basicProgram.init();
-    basicProgram.addShader(vShader);
-    basicProgram.addShader(fShader);
-    basicProgram.link();
-    if (!basicProgram.isLinked())
+    if (!basicProgram.linkFromFiles("shaders/basic.vs", "shaders/basic.fs"))
     {
-        std::cout << "Shader Linking Error" << std::endl;
+        std::cout << "Shader Error" << std::endl;
         std::cout << "" << basicProgram.log() << std::endl << std::endl;
     }
     basicProgram.bindFragmentOutput("fragColor");
-    vShader.free();
-    fShader.free();
 }
@@ -1,21 +1,33 @@
 #ifndef _SCENE_INCLUDE
 #define _SCENE_INCLUDE
 
+#include "Bvh.h"
 #include "Camera.h"
+#include "DistanceSort.h"
+#include "FrameArena.h"
+#include "GeometryBuffer.h"
+#include "JobSystem.h"
+#include "Instance.h"
+#include "MeshManager.h"
+#include "PerfCounters.h"
 #include "Query.h"
 #include "QueryPool.h"
+#include "RenderStats.h"
 #include "ShaderProgram.h"
+#include "StreamBuffer.h"
+#include "TraversalOrder.h"
 #include "TriangleMesh.h"
 #include "Quadtree.h"
+#include "VisibilityOracle.h"
+#include "VisibilitySet.h"
 
-#define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
-#include <glm/gtx/hash.hpp>
 
-#include <queue>
-#include <stack>
+#include <future>
+#include <memory>
+#include <string>
 #include <utility>
-#include <unordered_set>
+#include <vector>
 
 // Scene contains all the entities of our game.
 // It is responsible for updating and render them.
@@ -23,6 +35,21 @@ class Scene
 {
 
 public:
+    enum OcclusionQueriesAlgorithm
+    {
+        NONE,
+        STOP_AND_WAIT,
+        ADVANCED,
+        CHC
+    };
+
+    // Hierarchy used by CHC and the hierarchical frustum culling
+    enum HierarchyType
+    {
+        QUADTREE,
+        BVH
+    };
+
     Scene();
     ~Scene();
 
@@ -30,46 +57,106 @@ public:
     bool loadMesh(const char *filename);
     void update(int deltaTime);
     int render();
+    void resize(int width, int height);
+
+    // The objects are either copies of a mesh placed in a grid of gridSize x gridSize or described by a scene file
+    static const int MAX_GRID_SIZE = 1024;
+    void setGridSize(int gridSize);
+    int getGridSize() const {return n;}
+    bool loadScene(const std::string &filename);
+
+    void setOcclusionCulling(int algorithm) {occlusionCulling = algorithm;}
+    void setFrustumCulling(bool enabled) {frustumCulling = enabled;}
+    void setHierarchyType(int type) {hierarchyType = type;}
+    void setQuadtreeLayout(int layout);
+    void setValidationMode(bool enabled);
+    void setAnimation(bool enabled) {animate = enabled;}
+    void setPipelined(bool enabled) {pipelined = enabled;}
+    void setMeshletCulling(bool enabled) {meshletCulling = enabled;}
+    void setPerfCounters(bool enabled);
 
     Camera &getCamera() {return camera;}
+    const RenderStats &getStats() const {return stats;}
+    bool isLoadingMeshes() const {return meshManager.isLoading();}
 
 private:
     // Frustum culling implementation
     bool insideFrustum(const AABB &aabb) const;
-    bool insideFrustum(const glm::ivec2 &gridPosition) const;
+    bool insideFrustum(int object) const;
     
+    // Visibility work of a frame that needs no GL, done before submitting it
+    struct FrameData
+    {
+        CameraSnapshot camera;
+        int occlusionCulling;
+        bool frustumCulling;
+        int hierarchyType;
+        unsigned int objectsVersion;
+        std::vector<int> drawList;              // Objects inside the frustum, front to back for the advanced strategy
+        std::vector<unsigned char> inside;
+        std::vector<DistanceObject> distances;
+        int nodesTraversed;
+        int nodesFrustumCulled;
+    };
+    const FrameData &prepareStage();
+    void setUpFrame(FrameData &frame);
+    bool isUpToDate(const FrameData &frame) const;
+    void prepareFrame(FrameData &frame, PerfCounters &counters);
+    void prepareBvh(FrameData &frame);
+    static void prepareFrameJob(void *scene, int index, int);
+    void finishPrepare();
+
     // Scene rendering algorithms
-    int renderBasic();
-    int renderStopAndWait();
-    int renderAdvanced();
+    int renderBasic(const FrameData &frame);
+    int renderStopAndWait(const FrameData &frame);
+    int renderAdvanced(const FrameData &frame);
     int renderCHC();
 
+    // Scene construction
+    int addMesh(const std::string &filename);
+    void updateLoadedMeshes();
+    void buildObjects(const AABB &floorBounds);
+
     // Objects rendering
-    void render(const glm::ivec2 &gridPosition);
-    void renderBoundingBox(const glm::ivec2 &gridPosition, bool wireframe);
+    void renderObject(int object);
+    void renderBoundingBox(const AABB &aabb, bool wireframe);
     void renderBoundingBox(const glm::mat4 &model, bool wireframe);
     void renderFloor();
-    static glm::vec3 worldPosition(const glm::ivec2 &gridPosition);
+    int numObjects() const {return instances.size();}
 
-    // CHC implementation functions
+    // Ground truth of the visible objects (validation mode)
+    void renderGroundTruth();
+
+    // CHC implementation functions, for any of the hierarchies
+    using NodeIndex = std::size_t;
     void buildSceneHierarchy();
-    void buildSceneHierarchy(QuadtreeNodeIndex nodeIndex);
-    void pullUpVisibility(QuadtreeNodeIndex nodeIndex);
-    void addChildren(QuadtreeNodeIndex nodeIndex, std::stack<QuadtreeNodeIndex> &nodes);
-    int render(QuadtreeNodeIndex nodeIndex);
-    void renderBoundingBox(QuadtreeNodeIndex nodeIndex, bool wireframe);
-    Query renderWithQuery(QuadtreeNodeIndex nodeIndex);
-    Query issueQuery(QuadtreeNodeIndex nodeIndex);
-    void renderSceneHierarchy(QuadtreeNodeIndex nodeIndex);
+    template <typename Hierarchy> int renderCHC(Hierarchy &hierarchy);
+    template <typename Hierarchy> void pullUpVisibility(Hierarchy &hierarchy, NodeIndex nodeIndex);
+    template <typename Hierarchy> void addChildren(Hierarchy &hierarchy, NodeIndex nodeIndex, ArenaVector<NodeIndex> &nodes);
+    template <typename Hierarchy> int render(Hierarchy &hierarchy, NodeIndex nodeIndex);
+    template <typename Hierarchy> Query renderWithQuery(Hierarchy &hierarchy, NodeIndex nodeIndex);
+    template <typename Hierarchy> void renderSceneHierarchy(Hierarchy &hierarchy, NodeIndex nodeIndex);
+    Query issueQuery(const AABB &aabb);
+
+    // Dynamic objects
+    void updateDynamicObjects();
+    float hierarchyCostRatio() const;
+    void startRebuild();
+    void finishRebuild();
+    template <typename Hierarchy> void seedVisibility(Hierarchy &hierarchy);
 
     // Others
+    bool isVisible(const Query &query);
+    void checkSteadyStateAllocations(long long allocations);
     void initShaders();
-    float distanceToCamera(const glm::ivec2 &gridPosition);
 
 private:
     // Scene elements
     Camera camera;
-    TriangleMesh mesh;
+    GeometryBuffer geometry;        // Vertices of all the meshes below, destroyed after them
+    std::vector<std::shared_ptr<TriangleMesh>> meshes;     // Shared with the other tables through the manager
+    std::vector<Instance> instances;
+    std::string gridMeshFile;
     TriangleMesh cube;
     TriangleMesh floor;
     ShaderProgram basicProgram;
@@ -80,29 +167,81 @@ private:
     bool pathMode;
     bool frustumCulling;
     int occlusionCulling;
-    int n;
+    int n;                      // Side of the grid, 0 for scenes loaded from a file
+    int gridSizeInput;
+    char sceneFileInput[256];
     unsigned int currentFrame;
+    RenderStats stats;
+    CameraSnapshot frameCamera;     // Camera the submitted frame was prepared with
 
-    enum OcclusionQueriesAlgorithm
-    {
-        NONE,
-        STOP_AND_WAIT,
-        ADVANCED,
-        CHC
-    };
+    // Pipelined mode: the next frame is prepared by a job while the GL thread submits the current one
+    bool pipelined;
+    FrameData frames[2];
+    int submitIndex;                // Frame to submit, the other one is being prepared
+    JobGroup prepareJob;
+    unsigned int objectsVersion;    // Changes whenever the objects are rebuilt
+
+    // Workers for the CPU side of the frame (culling, distances) and the hierarchy builds
+    JobSystem jobSystem;
+
+    // Reads the meshes in the background and streams them to OpenGL, destroyed before the jobs it uses
+    MeshManager meshManager;
+
+    // Memory of the current frame, reset at the beginning of every frame
+    // The containers that live across frames are preallocated and invalidated with frame stamps
+    FrameArena frameArena;
+    int lastOcclusionCulling;
+    int lastHierarchyType;
+    int warmupFrames;
+    std::vector<unsigned int> renderedFrame;
 
-    using QueryInfo = std::pair<Query,glm::ivec2>;
-    using DistancePosition = std::pair<float,glm::ivec2>;
+    using QueryInfo = std::pair<Query,int>;
 
     // Occlusion culling data (Advanced)
     QueryPool queryPool;
-    std::queue<QueryInfo> previousFrameQueries;
-    std::unordered_set<glm::ivec2> PVS;
+    TraversalOrder traversalOrder;     // Grid scenes
+    DistanceSorter distanceSorter;     // Other scenes
+    std::vector<QueryInfo> previousFrameQueries;
+    VisibilitySet PVS;
+    VisibilitySet nextPVS;
+    unsigned int pvsFrame;      // Frame in which the PVS was computed
 
     // Occlusion culling data (CHC)
+    int hierarchyType;
+    int quadtreeLayout;
     Quadtree sceneHierarchy;
-    int maxDepth;
-    std::vector<std::vector<bool>> alreadyRendered;
+    Bvh bvh;
+
+    // Dynamic objects: some of the instances move every frame and the hierarchies are refitted,
+    // and rebuilt in the background once the refits have degraded them too much
+    bool animate;
+    std::vector<AABB> objectBounds;         // World space bounds of every object
+    std::vector<int> movingObjects;
+    std::vector<glm::mat4> restModels;      // Model of every moving object at rest
+    std::vector<AABB> rebuildBounds;        // Bounds the hierarchies are being rebuilt from
+    Quadtree nextSceneHierarchy;
+    Bvh nextBvh;
+    std::future<void> rebuild;              // Destroyed first, waits for the rebuild
+    int rebuilds;
+
+    // Meshlet culling: the meshlets of every drawn object are culled against the frustum and by their normal cones
+    bool meshletCulling;
+    std::vector<unsigned char> meshletVisible;      // Room for the meshlets of the largest mesh
+    std::vector<GLint> meshletFirst;
+    std::vector<GLsizei> meshletCount;
+    // With ARB_multi_draw_indirect the ranges are written in place as draw commands instead
+    static const int MESHLET_COMMANDS_REGION_SIZE = 4 << 20;     // Bytes per frame
+    StreamBuffer meshletCommands;
+
+    // Validation data
+    VisibilityOracle oracle;
+    bool validationMode;
+    int viewportWidth, viewportHeight;
+
+    // Hardware counters of the phases of a frame
+    PerfCounters perfCounters;
+    PerfCounters unmeasured;        // Never opened, for the phases that run in the jobs
+    bool perfCountersEnabled;
 
 };
 
@@ -0,0 +1,108 @@
+#include "SceneDescription.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+glm::mat4 InstanceDescription::model() const
+{
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), translation);
+    model = glm::rotate(model, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    model = glm::rotate(model, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::scale(model, scale);
+    return model;
+}
+
+
+static std::string directoryOf(const std::string &filename)
+{
+    std::size_t slash = filename.find_last_of('/');
+    return slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+}
+
+
+bool SceneDescription::load(const std::string &filename)
+{
+    std::ifstream fin(filename);
+    if (!fin.is_open()) {
+        std::cout << "Couldn't open scene file " << filename << std::endl;
+        return false;
+    }
+
+    meshes.clear();
+    instances.clear();
+    std::map<std::string, int> meshIndices;
+    std::string directory = directoryOf(filename);
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(fin, line)) {
+        ++lineNumber;
+        std::size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+
+        std::istringstream sin(line);
+        std::string keyword;
+        if (!(sin >> keyword)) continue;
+
+        if (keyword == "mesh") {
+            std::string name, path;
+            if (!(sin >> name >> path)) {
+                std::cout << filename << ":" << lineNumber << ": expected mesh <name> <file>" << std::endl;
+                return false;
+            }
+            if (path[0] != '/') path = directory + path;
+            meshIndices[name] = meshes.size();
+            meshes.push_back(path);
+        }
+        else if (keyword == "instance") {
+            std::string name;
+            sin >> name;
+            auto mesh = meshIndices.find(name);
+            if (mesh == meshIndices.end()) {
+                std::cout << filename << ":" << lineNumber << ": unknown mesh " << name << std::endl;
+                return false;
+            }
+
+            InstanceDescription instance;
+            instance.mesh = mesh->second;
+            instance.translation = glm::vec3(0.0f);
+            instance.rotation = glm::vec3(0.0f);
+            instance.scale = glm::vec3(1.0f);
+            instance.color = glm::vec4(0.9f, 0.9f, 0.95f, 1.0f);
+
+            std::string attribute;
+            while (sin >> attribute) {
+                glm::vec3 v;
+                if (!(sin >> v.x >> v.y >> v.z)) {
+                    std::cout << filename << ":" << lineNumber << ": expected three values after " << attribute << std::endl;
+                    return false;
+                }
+                if (attribute == "translate") instance.translation = v;
+                else if (attribute == "rotate") instance.rotation = v;
+                else if (attribute == "scale") instance.scale = v;
+                else if (attribute == "color") instance.color = glm::vec4(v, 1.0f);
+                else {
+                    std::cout << filename << ":" << lineNumber << ": unknown attribute " << attribute << std::endl;
+                    return false;
+                }
+            }
+            instances.push_back(instance);
+        }
+        else {
+            std::cout << filename << ":" << lineNumber << ": unknown keyword " << keyword << std::endl;
+            return false;
+        }
+    }
+
+    if (instances.empty()) {
+        std::cout << "Scene file " << filename << " has no instances" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef _SCENE_DESCRIPTION_INCLUDE
+#define _SCENE_DESCRIPTION_INCLUDE
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// Contents of a scene file, one entry per line (# starts a comment):
+//   mesh <name> <file.ply>
+//   instance <mesh name> [translate x y z] [rotate x y z] [scale x y z] [color r g b]
+// Rotations are in degrees (applied in x, y, z order) and mesh paths are relative to the scene file
+struct InstanceDescription
+{
+    int mesh;
+    glm::vec3 translation;
+    glm::vec3 rotation;
+    glm::vec3 scale;
+    glm::vec4 color;
+
+    glm::mat4 model() const;
+};
+
+struct SceneDescription
+{
+    std::vector<std::string> meshes;    // Paths of the PLY files
+    std::vector<InstanceDescription> instances;
+
+    bool load(const std::string &filename);
+};
+
+#endif // _SCENE_DESCRIPTION_INCLUDE
@@ -1,6 +1,50 @@
 #include "ShaderProgram.h"
 #include <glm/gtc/type_ptr.hpp>
 
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+// Bumped whenever what goes into the key or the files changes
+static const std::uint32_t BINARY_CACHE_VERSION = 1;
+static const char BINARY_MAGIC[8] = {'P', 'R', 'O', 'G', 'B', 'I', 'N', 'Y'};
+
+struct ProgramBinaryHeader
+{
+    char magic[8];
+    std::uint32_t format;
+    std::uint32_t length;
+};
+
+std::string ShaderProgram::binaryCacheDirectory = "shader_cache";
+
+static bool readFile(const std::string &filename, std::string &contents)
+{
+    std::ifstream fin(filename.c_str(), std::ios::binary);
+    if (!fin.is_open())
+        return false;
+    contents.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// FNV-1a, the strings are terminated so that their boundaries count
+static void hashString(std::uint64_t &hash, const std::string &text)
+{
+    const std::uint64_t prime = 1099511628211ull;
+    for (char c : text)
+        hash = (hash ^ static_cast<unsigned char>(c)) * prime;
+    hash = hash * prime;
+}
+
+static std::string glString(GLenum name)
+{
+    const GLubyte *value = glGetString(name);
+    return value ? reinterpret_cast<const char *>(value) : "";
+}
+
 ShaderProgram::ShaderProgram()
 {
     programId = 0;
@@ -22,6 +66,17 @@ void ShaderProgram::bindFragmentOutput(const std::string &outputName)
     glBindAttribLocation(programId, 0, outputName.c_str());
 }
 
+void ShaderProgram::bindAttributeLocation(const std::string &attribName, GLuint location)
+{
+    glBindAttribLocation(programId, location, attribName.c_str());
+    attributeBindings.emplace_back(attribName, location);
+}
+
+GLint ShaderProgram::getAttributeLocation(const std::string &attribName) const
+{
+    return glGetAttribLocation(programId, attribName.c_str());
+}
+
 GLint ShaderProgram::bindVertexAttribute(const std::string &attribName, GLint size, GLsizei stride, GLvoid *firstPointer)
 {
     GLint attribPos;
@@ -49,6 +104,124 @@ void ShaderProgram::free()
     glDeleteProgram(programId);
 }
 
+bool ShaderProgram::linkFromFiles(const std::string &vertexFile, const std::string &fragmentFile)
+{
+    std::string vertexSource, fragmentSource;
+
+    linked = false;
+    if (!readFile(vertexFile, vertexSource) || !readFile(fragmentFile, fragmentSource))
+    {
+        errorLog = "Couldn't read " + vertexFile + " or " + fragmentFile;
+        return false;
+    }
+
+    std::string cachePath;
+    if (!binaryCacheDirectory.empty() && GLEW_ARB_get_program_binary)
+    {
+        cachePath = binaryCachePath(vertexSource, fragmentSource);
+        if (loadBinary(cachePath))
+            return true;
+    }
+
+    Shader vShader, fShader;
+    vShader.initFromSource(VERTEX_SHADER, vertexSource);
+    fShader.initFromSource(FRAGMENT_SHADER, fragmentSource);
+    if (!vShader.isCompiled() || !fShader.isCompiled())
+    {
+        if (!vShader.isCompiled())
+            errorLog = vertexFile + ": " + vShader.log();
+        else
+            errorLog = fragmentFile + ": " + fShader.log();
+        vShader.free();
+        fShader.free();
+        return false;
+    }
+    addShader(vShader);
+    addShader(fShader);
+    if (!cachePath.empty())
+        glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    link();
+    glDetachShader(programId, vShader.getId());
+    glDetachShader(programId, fShader.getId());
+    vShader.free();
+    fShader.free();
+    if (linked && !cachePath.empty())
+        storeBinary(cachePath);
+
+    return linked;
+}
+
+std::string ShaderProgram::binaryCachePath(const std::string &vertexSource, const std::string &fragmentSource) const
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    char name[32];
+
+    hashString(hash, std::to_string(BINARY_CACHE_VERSION));
+    hashString(hash, vertexSource);
+    hashString(hash, fragmentSource);
+    for (const std::pair<std::string, GLuint> &binding : attributeBindings)
+        hashString(hash, binding.first + "=" + std::to_string(binding.second));
+    hashString(hash, glString(GL_VENDOR));
+    hashString(hash, glString(GL_RENDERER));
+    hashString(hash, glString(GL_VERSION));
+    snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(hash));
+
+    return binaryCacheDirectory + "/" + name;
+}
+
+// The driver may still reject a binary with the same key (e.g. after an update), then the program is compiled
+bool ShaderProgram::loadBinary(const std::string &path)
+{
+    std::string contents;
+    ProgramBinaryHeader header;
+    GLint status;
+
+    if (!readFile(path, contents) || contents.size() < sizeof(header))
+        return false;
+    memcpy(&header, contents.data(), sizeof(header));
+    if (memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 || contents.size() != sizeof(header) + header.length)
+        return false;
+
+    glProgramBinary(programId, header.format, contents.data() + sizeof(header), header.length);
+    glGetProgramiv(programId, GL_LINK_STATUS, &status);
+    linked = (status == GL_TRUE);
+    errorLog.clear();
+
+    return linked;
+}
+
+// Written to a temporary file renamed over the binary, so a binary is never read half written
+void ShaderProgram::storeBinary(const std::string &path) const
+{
+    GLint length = 0;
+    ProgramBinaryHeader header;
+    std::error_code error;
+
+    glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(programId, length, &length, &format, binary.data());
+    if (length <= 0)
+        return;
+
+    memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.format = format;
+    header.length = length;
+    std::filesystem::create_directories(binaryCacheDirectory, error);
+    std::string temporaryPath = path + ".tmp";
+    bool written = false;
+    {
+        std::ofstream fout(temporaryPath.c_str(), std::ios::binary);
+        fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        fout.write(binary.data(), length);
+        written = fout.good();
+    }
+    if (!written || std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+        std::remove(temporaryPath.c_str());
+}
+
 void ShaderProgram::use()
 {
     glUseProgram(programId);
@@ -72,6 +245,14 @@ void ShaderProgram::setUniform1i(const std::string &uniformName, int v)
         glUniform1i(location, v);
 }
 
+void ShaderProgram::setUniform1ui(const std::string &uniformName, unsigned int v)
+{
+    GLint location = glGetUniformLocation(programId, uniformName.c_str());
+
+    if (location != -1)
+        glUniform1ui(location, v);
+}
+
 void ShaderProgram::setUniform2f(const std::string &uniformName, float v0, float v1)
 {
     GLint location = glGetUniformLocation(programId, uniformName.c_str());
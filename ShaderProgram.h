@@ -2,6 +2,8 @@
 #define _SHADER_PROGRAM_INCLUDE
 
 #include <string>
+#include <utility>
+#include <vector>
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <glm/glm.hpp>
@@ -10,6 +12,10 @@
 // Using the Shader class ShaderProgram can link a vertex and a fragment shader
 // together, bind input attributes to their corresponding vertex shader names,
 // and bind the fragment output to a name from the fragment shader
+// Programs built from files go through a cache of program binaries (ARB_get_program_binary), stored in the
+// cache directory under a hash of their sources, their attribute bindings and the driver (vendor, renderer
+// and version strings). Later runs load the binary instead of compiling, and compile again whenever the
+// driver rejects it
 
 class ShaderProgram
 {
@@ -20,14 +26,24 @@ public:
     void init();
     void addShader(const Shader &shader);
     void bindFragmentOutput(const std::string &outputName);
+    void bindAttributeLocation(const std::string &attribName, GLuint location); // Before linking
+    GLint getAttributeLocation(const std::string &attribName) const;
     GLint bindVertexAttribute(const std::string &attribName, GLint size, GLsizei stride, GLvoid *firstPointer);
     void link();
     void free();
 
+    // Compiles and links the shaders of the files, or loads the binary linked by a previous run.
+    // Called after init and the attribute bindings, the errors are left in the log
+    bool linkFromFiles(const std::string &vertexFile, const std::string &fragmentFile);
+
+    // Empty disables the cache
+    static void setBinaryCacheDirectory(const std::string &directory) {binaryCacheDirectory = directory;}
+
     void use();
 
     // Pass uniforms to the associated shaders
     void setUniform1i(const std::string &uniformName, int v);
+    void setUniform1ui(const std::string &uniformName, unsigned int v);
     void setUniform2f(const std::string &uniformName, float v0, float v1);
     void setUniform3f(const std::string &uniformName, float v0, float v1, float v2);
     void setUniform4f(const std::string &uniformName, float v0, float v1, float v2, float v3);
@@ -38,10 +54,18 @@ public:
     bool isLinked();
     const std::string &log() const;
 
+private:
+    std::string binaryCachePath(const std::string &vertexSource, const std::string &fragmentSource) const;
+    bool loadBinary(const std::string &path);
+    void storeBinary(const std::string &path) const;
+
 private:
     GLuint programId;
     bool linked;
     std::string errorLog;
+    std::vector<std::pair<std::string, GLuint>> attributeBindings;     // Part of the binary cache key
+
+    static std::string binaryCacheDirectory;
 };
 
 #endif // _SHADER_PROGRAM_INCLUDE
@@ -0,0 +1,99 @@
+#include "StreamBuffer.h"
+
+StreamBuffer::StreamBuffer()
+    : buffer(0)
+    , target(GL_ARRAY_BUFFER)
+    , mapped(nullptr)
+    , regionSize(0)
+    , region(0)
+    , used(0)
+    , stalls(0)
+{
+    for (GLsync &fence : fences) fence = nullptr;
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    for (GLsync fence : fences)
+        if (fence) glDeleteSync(fence);
+    if (buffer) {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+        glDeleteBuffers(1, &buffer);
+    }
+}
+
+bool StreamBuffer::init(GLenum bufferTarget, std::size_t bytesPerRegion)
+{
+    if (buffer) return isMapped();
+    if (!GLEW_ARB_buffer_storage) return false;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr size = static_cast<GLsizeiptr>(NUM_REGIONS) * bytesPerRegion;
+    target = bufferTarget;
+    regionSize = bytesPerRegion;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferStorage(target, size, nullptr, flags);
+    mapped = static_cast<char *>(glMapBufferRange(target, 0, size, flags));
+    glBindBuffer(target, 0);
+    if (!mapped) {
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        return false;
+    }
+
+    // Allocations before the first frame fail
+    region = NUM_REGIONS - 1;
+    used = regionSize;
+    return true;
+}
+
+void StreamBuffer::beginFrame()
+{
+    if (!mapped) return;
+
+    region = (region + 1) % NUM_REGIONS;
+    GLsync &fence = fences[region];
+    if (fence) {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            ++stalls;
+            do status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            while (status == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    used = 0;
+    glBindBuffer(target, buffer);
+}
+
+void StreamBuffer::endFrame()
+{
+    if (!mapped) return;
+
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Nothing else is allocated in the region until the next frame
+    used = regionSize;
+}
+
+void *StreamBuffer::allocate(std::size_t size, std::size_t alignment)
+{
+    std::size_t offset = used.load(std::memory_order_relaxed);
+    std::size_t start;
+    do {
+        start = (offset + alignment - 1) / alignment * alignment;
+        if (start + size > regionSize) return nullptr;
+    } while (!used.compare_exchange_weak(offset, start + size, std::memory_order_relaxed));
+
+    return mapped + static_cast<std::size_t>(region) * regionSize + start;
+}
+
+void StreamBuffer::shrink(void *pointer, std::size_t size, std::size_t newSize)
+{
+    std::size_t start = static_cast<char *>(pointer) - mapped - static_cast<std::size_t>(region) * regionSize;
+    std::size_t end = start + size;
+    used.compare_exchange_strong(end, start + newSize, std::memory_order_relaxed);
+}
@@ -0,0 +1,60 @@
+#ifndef _STREAM_BUFFER_INCLUDE
+#define _STREAM_BUFFER_INCLUDE
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <atomic>
+#include <cstddef>
+
+// StreamBuffer holds the data written every frame for the GPU (e.g. draw commands) in a buffer that stays
+// persistently and coherently mapped, so it is written in place with neither copies nor implicit syncs
+// The buffer is a ring of NUM_REGIONS regions, one per frame in flight: a frame allocates from its own region
+// and fences it once its last draw is issued, and the region is only reused when that fence is signaled.
+// Allocations are lock free, so any thread (e.g. a culling job) may write into the region of the frame.
+// Without ARB_buffer_storage nothing is mapped and the callers keep their data in client memory
+class StreamBuffer
+{
+
+public:
+    static const int NUM_REGIONS = 3;
+
+    StreamBuffer();
+    ~StreamBuffer();
+
+    // Returns false when the buffer can't be mapped
+    bool init(GLenum target, std::size_t regionSize);
+    bool isMapped() const {return mapped != nullptr;}
+
+    // GL thread: begins a frame in the next region, waiting for the GPU to finish with it if needed, and binds
+    // the buffer to its target
+    void beginFrame();
+    // GL thread: after the last command that reads the region of the frame
+    void endFrame();
+
+    // Room in the region of the frame, null when it is full
+    void *allocate(std::size_t size, std::size_t alignment);
+    // Gives back the end of an allocation that turned out larger than needed, unless something was allocated after it
+    void shrink(void *pointer, std::size_t size, std::size_t newSize);
+    // Offset in the buffer of an allocation, as passed to the commands that read it
+    GLintptr getOffset(const void *pointer) const {return static_cast<const char *>(pointer) - mapped;}
+
+    int getStalls() const {return stalls;}         // Frames that had to wait for their region
+
+private:
+    StreamBuffer(const StreamBuffer &) = delete;
+    StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+private:
+    GLuint buffer;
+    GLenum target;
+    char *mapped;
+    std::size_t regionSize;
+    int region;
+    std::atomic<std::size_t> used;      // Bytes of the current region
+    GLsync fences[NUM_REGIONS];
+    int stalls;
+
+};
+
+#endif // _STREAM_BUFFER_INCLUDE
@@ -0,0 +1,79 @@
+#include "TraversalOrder.h"
+
+#include <algorithm>
+#include <cmath>
+
+TraversalOrder::TraversalOrder()
+    : n(0)
+    , valid(false)
+    , generations(0)
+{
+
+}
+
+
+void TraversalOrder::init(int n)
+{
+    this->n = n;
+    valid = false;
+    order.reserve(n*n);
+    scratch.reserve(n*n);
+    sorter.reserve(n*n);
+
+    // Every offset from a cell of the grid to any other one, ring after ring
+    // Ties are broken by the offset itself so the order is deterministic
+    offsets.clear();
+    offsets.reserve((2*n - 1) * (2*n - 1));
+    for (int i = -(n - 1); i <= n - 1; ++i)
+        for (int j = -(n - 1); j <= n - 1; ++j)
+            offsets.emplace_back(i, j);
+
+    auto closer = [](const glm::ivec2 &a, const glm::ivec2 &b) {
+        int da = a.x * a.x + a.y * a.y;
+        int db = b.x * b.x + b.y * b.y;
+        if (da != db) return da < db;
+        return a.x != b.x ? a.x < b.x : a.y < b.y;
+    };
+    std::sort(offsets.begin(), offsets.end(), closer);
+}
+
+
+const std::vector<int> &TraversalOrder::frontToBack(const glm::vec3 &viewpoint)
+{
+    // Object (i, j) is placed at (i, 0, -j)
+    glm::ivec2 viewpointCell(std::lround(viewpoint.x), std::lround(-viewpoint.z));
+    if (!valid || viewpointCell != cell) {
+        generate(viewpointCell);
+        cell = viewpointCell;
+        valid = true;
+        ++generations;
+    }
+    return order;
+}
+
+
+void TraversalOrder::generate(const glm::ivec2 &cell)
+{
+    order.clear();
+    bool insideGrid = cell.x >= 0 && cell.x < n && cell.y >= 0 && cell.y < n;
+    if (insideGrid) {
+        for (const glm::ivec2 &offset : offsets) {
+            glm::ivec2 gridPosition = cell + offset;
+            if (gridPosition.x >= 0 && gridPosition.x < n && gridPosition.y >= 0 && gridPosition.y < n)
+                order.push_back(gridPosition.x * n + gridPosition.y);
+        }
+        return;
+    }
+
+    // The offsets do not reach the whole grid from outside of it, sort once for this cell
+    scratch.clear();
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            glm::ivec2 offset = glm::ivec2(i, j) - cell;
+            scratch.emplace_back(static_cast<float>(offset.x * offset.x + offset.y * offset.y), i * n + j);
+        }
+    }
+    sorter.sort(scratch);
+    for (const DistanceObject &object : scratch)
+        order.push_back(object.second);
+}
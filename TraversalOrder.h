@@ -0,0 +1,41 @@
+#ifndef _TRAVERSAL_ORDER_INCLUDE
+#define _TRAVERSAL_ORDER_INCLUDE
+
+#include "DistanceSort.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Front to back order of the objects of the n x n grid
+// On a regular grid the order only depends on the cell the camera is in, so it is generated
+// when the camera crosses a cell boundary and reused meanwhile instead of sorting every frame
+class TraversalOrder
+{
+
+public:
+    TraversalOrder();
+
+    void init(int n);
+
+    // Ids of the objects (i * n + j) front to back from the viewpoint
+    const std::vector<int> &frontToBack(const glm::vec3 &viewpoint);
+
+    // Number of times the order has been generated (camera cell changes)
+    int getGenerations() const {return generations;}
+
+private:
+    void generate(const glm::ivec2 &cell);
+
+private:
+    int n;
+    std::vector<glm::ivec2> offsets;        // Cells around the origin sorted by distance, computed once
+    std::vector<int> order;
+    std::vector<DistanceObject> scratch;  // Camera outside of the grid
+    DistanceSorter sorter;
+    glm::ivec2 cell;
+    bool valid;
+    int generations;
+};
+
+#endif // _TRAVERSAL_ORDER_INCLUDE
@@ -1,8 +1,16 @@
 #include "TriangleMesh.h"
 
 #include <limits>
+#include <utility>
 
 TriangleMesh::TriangleMesh()
+    : numTriangles(0)
+    , geometry(nullptr)
+    , firstVertex(0)
+    , vertexSize(6)
+    , bufferSize(0)
+    , resident(false)
+    , loadFailed(false)
 {
     aabb.min = glm::vec3(std::numeric_limits<float>::max());
     aabb.max = glm::vec3(-std::numeric_limits<float>::max());
@@ -10,8 +18,9 @@ TriangleMesh::TriangleMesh()
 
 TriangleMesh::~TriangleMesh()
 {
-    glDeleteBuffers(1, &vbo);
-    glDeleteVertexArrays(1, &vao);
+    // Meshes that never reached OpenGL (e.g. loaded without a context) own no vertices
+    if (geometry)
+        geometry->free(vertexSize, firstVertex, 3 * numTriangles);
 }
 
 void TriangleMesh::addVertex(const glm::vec3 &position)
@@ -26,6 +35,25 @@ void TriangleMesh::addTriangle(int v0, int v1, int v2)
     triangles.push_back(v0);
     triangles.push_back(v1);
     triangles.push_back(v2);
+    ++numTriangles;
+}
+
+void TriangleMesh::setGeometry(std::vector<glm::vec3> &&positions, std::vector<int> &&indices, const AABB &bounds)
+{
+    vertices = std::move(positions);
+    triangles = std::move(indices);
+    numTriangles = triangles.size() / 3;
+    aabb = bounds;
+}
+
+void TriangleMesh::setNormals(std::vector<glm::vec3> &&vertexNormals)
+{
+    normals = std::move(vertexNormals);
+}
+
+void TriangleMesh::setColors(std::vector<glm::vec4> &&vertexColors)
+{
+    colors = std::move(vertexColors);
 }
 
 
@@ -68,10 +96,17 @@ void TriangleMesh::buildQuad()
     addTriangle(3, 1, 2);
 }
 
-void TriangleMesh::sendToOpenGL(ShaderProgram &program)
+void TriangleMesh::sortMeshletTriangles()
 {
-    std::vector<float> data;
+    Meshlets::sortTriangles(vertices, triangles);
+}
+
+void TriangleMesh::buildVertexBuffer(std::vector<float> &data) const
+{
+    bool hasColors = !colors.empty();
 
+    data.clear();
+    data.reserve(triangles.size() * getVertexSize());
     for (unsigned int tri = 0; tri < triangles.size(); tri += 3)
     {
         glm::vec3 normal;
@@ -81,30 +116,78 @@ void TriangleMesh::sendToOpenGL(ShaderProgram &program)
         normal = glm::normalize(normal);
         for (unsigned int vrtx = 0; vrtx < 3; vrtx++)
         {
-            data.push_back(vertices[triangles[tri + vrtx]].x);
-            data.push_back(vertices[triangles[tri + vrtx]].y);
-            data.push_back(vertices[triangles[tri + vrtx]].z);
+            int vertex = triangles[tri + vrtx];
+            if (!normals.empty())
+                normal = normals[vertex];
+
+            data.push_back(vertices[vertex].x);
+            data.push_back(vertices[vertex].y);
+            data.push_back(vertices[vertex].z);
 
             data.push_back(normal.x);
             data.push_back(normal.y);
             data.push_back(normal.z);
+
+            if (hasColors)
+            {
+                data.push_back(colors[vertex].r);
+                data.push_back(colors[vertex].g);
+                data.push_back(colors[vertex].b);
+                data.push_back(colors[vertex].a);
+            }
         }
     }
+}
+
+void TriangleMesh::sendToOpenGL(GeometryBuffer &buffer)
+{
+    std::vector<float> data;
 
-    // Send data to OpenGL
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
-    posLocation = program.bindVertexAttribute("mPos", 3, 6 * sizeof(float), 0);
-    normalLocation = program.bindVertexAttribute("mNormal", 3, 6 * sizeof(float), (void *)(3 * sizeof(float)));
+    buildVertexBuffer(data);
+    sendToOpenGL(buffer, data.data(), 3 * numTriangles, getVertexSize());
+}
+
+// Uploads a vertex buffer built before (e.g. read from the mesh cache), the mesh may have no arrays of its own
+void TriangleMesh::sendToOpenGL(GeometryBuffer &buffer, const float *data, int numVertices, int vertexSize)
+{
+    if (geometry)
+        geometry->free(this->vertexSize, firstVertex, 3 * numTriangles);
+    numTriangles = numVertices / 3;
+    geometry = &buffer;
+    this->vertexSize = vertexSize;
+    firstVertex = buffer.allocate(vertexSize, numVertices, data);
+    bufferSize = static_cast<std::size_t>(numVertices) * vertexSize * sizeof(float);
+    resident = data != nullptr;
+}
+
+void TriangleMesh::releaseCPUData()
+{
+    std::vector<glm::vec3>().swap(vertices);
+    std::vector<glm::vec3>().swap(normals);
+    std::vector<glm::vec4>().swap(colors);
+    std::vector<int>().swap(triangles);
+}
+
+std::size_t TriangleMesh::getCPUMemory() const
+{
+    return vertices.capacity() * sizeof(glm::vec3) + normals.capacity() * sizeof(glm::vec3) +
+           colors.capacity() * sizeof(glm::vec4) + triangles.capacity() * sizeof(int) + meshlets.getMemory();
 }
 
 void TriangleMesh::render() const
 {
-    glBindVertexArray(vao);
-    glEnableVertexAttribArray(posLocation);
-    glEnableVertexAttribArray(normalLocation);
-    glDrawArrays(GL_TRIANGLES, 0, 3 * 2 * 3 * triangles.size() / 3);
+    geometry->bind(vertexSize);
+    glDrawArrays(GL_TRIANGLES, firstVertex, 3 * numTriangles);
+}
+
+void TriangleMesh::render(const GLint *first, const GLsizei *count, int numRanges) const
+{
+    geometry->bind(vertexSize);
+    glMultiDrawArrays(GL_TRIANGLES, first, count, numRanges);
+}
+
+void TriangleMesh::render(GLintptr commandsOffset, int numCommands) const
+{
+    geometry->bind(vertexSize);
+    glMultiDrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<const void *>(commandsOffset), numCommands, 0);
 }
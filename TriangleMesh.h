@@ -1,17 +1,15 @@
 #ifndef _TRIANGLE_MESH_INCLUDE
 #define _TRIANGLE_MESH_INCLUDE
 
+#include <utility>
 #include <vector>
 #include <glm/glm.hpp>
-#include "ShaderProgram.h"
+#include "AABB.h"
+#include "GeometryBuffer.h"
+#include "Meshlets.h"
 
 // Class TriangleMesh renders a very simple room with textures
 
-struct AABB {
-    glm::vec3 min;
-    glm::vec3 max;
-};
-
 class TriangleMesh
 {
 
@@ -22,20 +20,66 @@ public:
     void addVertex(const glm::vec3 &position);
     void addTriangle(int v0, int v1, int v2);
 
+    // Takes the arrays of a whole mesh at once, as decoded by the loaders, with their bounds
+    void setGeometry(std::vector<glm::vec3> &&positions, std::vector<int> &&indices, const AABB &bounds);
+
+    // Optional per vertex attributes, replacing the flat shading and the white vertex color
+    void setNormals(std::vector<glm::vec3> &&vertexNormals);
+    void setColors(std::vector<glm::vec4> &&vertexColors);
+
+    // Reorders the triangles so that the vertex buffer splits into meshlets (see Meshlets)
+    void sortMeshletTriangles();
+    void setMeshlets(Meshlets &&meshletTable) {meshlets = std::move(meshletTable);}
+    const Meshlets &getMeshlets() const {return meshlets;}
+
     void buildCube();
     void buildQuad();
 
-    void sendToOpenGL(ShaderProgram &program);
+    // Interleaved vertex buffer sent to OpenGL: position, normal and, with vertex colors, color of the three
+    // corners of every triangle
+    int getVertexSize() const {return colors.empty() ? 6 : 10;}
+    void buildVertexBuffer(std::vector<float> &data) const;
+
+    // The vertices go to a range of the shared geometry buffer, freed when the mesh is destroyed
+    void sendToOpenGL(GeometryBuffer &buffer);
+    void sendToOpenGL(GeometryBuffer &buffer, const float *data, int numVertices, int vertexSize);
     void render() const;
+    void render(const GLint *first, const GLsizei *count, int numRanges) const;    // Ranges from getFirstVertex()
+    void render(GLintptr commandsOffset, int numCommands) const;    // DrawArraysCommand in the bound indirect buffer
+
+    // Sent without data the buffer is filled later (e.g. streamed by the mesh loader), and the mesh is not
+    // resident until then
+    bool isResident() const {return resident;}
+    void setResident() {resident = true;}
+    // Its file couldn't be read, it stays non resident
+    bool hasLoadFailed() const {return loadFailed;}
+    void setLoadFailed() {loadFailed = true;}
+    GLuint getVertexBuffer() const {return geometry->getBuffer(vertexSize);}
+    GLintptr getBufferOffset() const {return static_cast<GLintptr>(firstVertex) * vertexSize * sizeof(float);}
+    int getFirstVertex() const {return firstVertex;}
+
+    // Drops the arrays the mesh was built from, once sent to OpenGL only the bounds and the meshlets are needed
+    void releaseCPUData();
+    std::size_t getCPUMemory() const;
+    std::size_t getGPUMemory() const {return bufferSize;}
+
+    int getNumTriangles() const {return numTriangles;}
     AABB aabb;
 
 private:
     std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec4> colors;
     std::vector<int> triangles;
+    int numTriangles;
+    Meshlets meshlets;
 
-    GLuint vao;
-    GLuint vbo;
-    GLint posLocation, normalLocation;
+    GeometryBuffer *geometry;
+    int firstVertex;
+    int vertexSize;
+    std::size_t bufferSize;        // Bytes
+    bool resident;
+    bool loadFailed;
 };
 
 #endif // _TRIANGLE_MESH_INCLUDE
@@ -0,0 +1,207 @@
+#include "VisibilityOracle.h"
+
+#include <algorithm>
+#include <iostream>
+
+VisibilityOracle::VisibilityOracle()
+    : fbo(0)
+    , idTexture(0)
+    , depthRenderbuffer(0)
+    , width(0)
+    , height(0)
+    , currentSlot(0)
+    , numObjects(0)
+{
+    for (Readback &readback : readbacks) {
+        readback.pbo = 0;
+        readback.fence = 0;
+        readback.pending = false;
+    }
+}
+
+
+VisibilityOracle::~VisibilityOracle()
+{
+    freeReadbacks();
+    freeTargets();
+    for (Readback &readback : readbacks)
+        if (readback.pbo) glDeleteBuffers(1, &readback.pbo);
+}
+
+
+void VisibilityOracle::init(const ShaderProgram &meshProgram, int numObjects)
+{
+    this->numObjects = numObjects;
+    for (std::vector<unsigned char> &drawnObjects : drawn)
+        drawnObjects.assign(numObjects, 0);
+    visible.assign(numObjects, 0);
+    freeReadbacks();
+
+    if (idProgram.isLinked()) return;
+
+    idProgram.init();
+    // Meshes are bound to the attribute locations of the program they were sent with
+    idProgram.bindAttributeLocation("mPos", meshProgram.getAttributeLocation("mPos"));
+    if (!idProgram.linkFromFiles("shaders/id.vs", "shaders/id.fs"))
+    {
+        std::cout << "Id Shader Error" << std::endl;
+        std::cout << "" << idProgram.log() << std::endl << std::endl;
+    }
+
+    for (Readback &readback : readbacks)
+        glGenBuffers(1, &readback.pbo);
+}
+
+
+void VisibilityOracle::resize(int width, int height)
+{
+    if (width == this->width && height == this->height) return;
+    if (width == 0 || height == 0) return;
+    this->width = width;
+    this->height = height;
+
+    // Results of the old size are not comparable anymore
+    freeReadbacks();
+    freeTargets();
+
+    glGenTextures(1, &idTexture);
+    glBindTexture(GL_TEXTURE_2D, idTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &depthRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, idTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Visibility oracle framebuffer is incomplete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    GLsizeiptr size = static_cast<GLsizeiptr>(width) * height * sizeof(GLuint);
+    for (Readback &readback : readbacks) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+void VisibilityOracle::begin(unsigned int frame, const glm::mat4 &view, const glm::mat4 &projection)
+{
+    currentSlot = frame % NUM_SLOTS;
+    Readback &readback = readbacks[currentSlot];
+    if (readback.pending) { // Never resolved, drop it
+        glDeleteSync(readback.fence);
+        readback.pending = false;
+    }
+    std::fill(drawn[currentSlot].begin(), drawn[currentSlot].end(), 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    const GLuint background[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, background);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    idProgram.use();
+    idProgram.setUniformMatrix4f("view", view);
+    idProgram.setUniformMatrix4f("projection", projection);
+}
+
+
+void VisibilityOracle::setObject(int objectId, const glm::mat4 &model)
+{
+    idProgram.setUniformMatrix4f("model", model);
+    idProgram.setUniform1ui("objectId", objectId + 1);
+}
+
+
+void VisibilityOracle::setOccluder(const glm::mat4 &model)
+{
+    idProgram.setUniformMatrix4f("model", model);
+    idProgram.setUniform1ui("objectId", 0);
+}
+
+
+void VisibilityOracle::end()
+{
+    Readback &readback = readbacks[currentSlot];
+
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    glReadPixels(0, 0, width, height, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.pending = true;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+
+void VisibilityOracle::markDrawn(int objectId)
+{
+    drawn[currentSlot][objectId] = 1;
+}
+
+
+// Called after end, resolves the frame before the current one
+bool VisibilityOracle::resolve(VisibilityAccuracy &accuracy)
+{
+    int slot = (currentSlot + 1) % NUM_SLOTS;
+    Readback &readback = readbacks[slot];
+    if (!readback.pending) return false;
+
+    // Issued a frame ago, so the wait is expected to return immediately
+    glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync(readback.fence);
+    readback.pending = false;
+
+    std::fill(visible.begin(), visible.end(), 0);
+    GLsizeiptr size = static_cast<GLsizeiptr>(width) * height * sizeof(GLuint);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    const GLuint *ids = static_cast<const GLuint *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+    if (ids) {
+        int numPixels = width * height;
+        for (int i = 0; i < numPixels; ++i) {
+            GLuint id = ids[i];
+            if (id != 0 && id <= static_cast<GLuint>(numObjects)) visible[id - 1] = 1;
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!ids) return false;
+
+    const std::vector<unsigned char> &drawnObjects = drawn[slot];
+    accuracy.visible = 0;
+    accuracy.falsePositives = 0;
+    accuracy.falseNegatives = 0;
+    for (int i = 0; i < numObjects; ++i) {
+        accuracy.visible += visible[i];
+        if (drawnObjects[i] && !visible[i]) ++accuracy.falsePositives;
+        if (!drawnObjects[i] && visible[i]) ++accuracy.falseNegatives;
+    }
+    return true;
+}
+
+
+void VisibilityOracle::freeTargets()
+{
+    if (fbo) glDeleteFramebuffers(1, &fbo);
+    if (idTexture) glDeleteTextures(1, &idTexture);
+    if (depthRenderbuffer) glDeleteRenderbuffers(1, &depthRenderbuffer);
+    fbo = idTexture = depthRenderbuffer = 0;
+}
+
+
+void VisibilityOracle::freeReadbacks()
+{
+    for (Readback &readback : readbacks) {
+        if (readback.pending) glDeleteSync(readback.fence);
+        readback.pending = false;
+    }
+}
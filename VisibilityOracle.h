@@ -0,0 +1,72 @@
+#ifndef _VISIBILITY_ORACLE_INCLUDE
+#define _VISIBILITY_ORACLE_INCLUDE
+
+#include "RenderStats.h"
+#include "ShaderProgram.h"
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// VisibilityOracle computes the exact set of visible objects of a frame (ground truth)
+// Every object is rendered without culling into an object id buffer that is read back
+// asynchronously through a pixel buffer object, so the result of a frame is available
+// on the next one and compared against the objects that the culling strategy drew
+class VisibilityOracle
+{
+
+public:
+    VisibilityOracle();
+    ~VisibilityOracle();
+
+    // The id program shares the vertex attribute locations of meshProgram
+    void init(const ShaderProgram &meshProgram, int numObjects);
+    void resize(int width, int height);
+
+    // Object id pass, objects are rendered between begin and end
+    void begin(unsigned int frame, const glm::mat4 &view, const glm::mat4 &projection);
+    void setObject(int objectId, const glm::mat4 &model);
+    void setOccluder(const glm::mat4 &model); // Geometry that hides objects but is not one
+    void end();
+
+    // Marks an object as drawn by the culling strategy in the current frame
+    void markDrawn(int objectId);
+
+    // Compares the ground truth of the previous frame with what was drawn on it
+    bool resolve(VisibilityAccuracy &accuracy);
+    // Forgets the frames not resolved yet
+    void dropReadbacks() {freeReadbacks();}
+
+private:
+    void freeTargets();
+    void freeReadbacks();
+
+private:
+    static const int NUM_SLOTS = 2;
+
+    // Pending read back of a frame
+    struct Readback
+    {
+        GLuint pbo;
+        GLsync fence;
+        bool pending;
+    };
+
+    ShaderProgram idProgram;
+    GLuint fbo;
+    GLuint idTexture;
+    GLuint depthRenderbuffer;
+    int width, height;
+
+    Readback readbacks[NUM_SLOTS];
+    int currentSlot;
+
+    // Objects drawn by the culling strategy (per slot) and objects found in the id buffer
+    int numObjects;
+    std::vector<unsigned char> drawn[NUM_SLOTS];
+    std::vector<unsigned char> visible;
+};
+
+#endif // _VISIBILITY_ORACLE_INCLUDE
@@ -0,0 +1,27 @@
+#include "VisibilitySet.h"
+
+#include <algorithm>
+
+VisibilitySet::VisibilitySet()
+    : numObjects(0)
+{
+
+}
+
+void VisibilitySet::resize(int numObjects)
+{
+    this->numObjects = numObjects;
+    words.assign((numObjects + 63) / 64, 0);
+}
+
+void VisibilitySet::clear()
+{
+    std::fill(words.begin(), words.end(), 0);
+}
+
+int VisibilitySet::count() const
+{
+    int total = 0;
+    for (uint64_t bits : words) total += __builtin_popcountll(bits);
+    return total;
+}
@@ -0,0 +1,47 @@
+#ifndef _VISIBILITY_SET_INCLUDE
+#define _VISIBILITY_SET_INCLUDE
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Set of visible objects as a dense bitset indexed by object id
+// The objects are a dense grid, so a bit per object is smaller and faster than hashing positions
+class VisibilitySet
+{
+
+public:
+    VisibilitySet();
+
+    void resize(int numObjects);   // Also clears the set
+    void clear();
+    int count() const;
+
+    bool test(int id) const {return (words[id >> 6] >> (id & 63)) & 1;}
+    void set(int id) {words[id >> 6] |= uint64_t(1) << (id & 63);}
+    void reset(int id) {words[id >> 6] &= ~(uint64_t(1) << (id & 63));}
+
+    // Calls f(id) for every object in the set, in increasing id order
+    template <typename F>
+    void forEach(F f) const
+    {
+        for (std::size_t i = 0; i < words.size(); ++i) {
+            uint64_t bits = words[i];
+            while (bits) {
+                f(static_cast<int>(i * 64 + __builtin_ctzll(bits)));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    // Double buffering, only the storage is exchanged
+    void swap(VisibilitySet &other) {words.swap(other.words); std::swap(numObjects, other.numObjects);}
+
+    int size() const {return numObjects;}
+
+private:
+    std::vector<uint64_t> words;
+    int numObjects;
+};
+
+#endif // _VISIBILITY_SET_INCLUDE
@@ -0,0 +1,65 @@
+#include "Benchmark.h"
+
+#include <cstdio>
+
+BenchmarkRunner::BenchmarkRunner(double minTime, const std::string &filter, bool usePerfCounters)
+    : minTime(minTime)
+    , filter(filter)
+{
+    if (usePerfCounters && !perfCounters.open())
+        fprintf(stderr, "Hardware performance counters are not available, reporting time only\n");
+}
+
+bool BenchmarkRunner::selected(const std::string &name) const
+{
+    return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+void BenchmarkRunner::addResult(const std::string &name, long long iterations, double seconds, long long itemsPerOp, const PerfCounts &counts)
+{
+    BenchmarkResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = seconds * 1e9 / iterations;
+    result.itemsPerSecond = static_cast<double>(itemsPerOp) * iterations / seconds;
+    result.countsPerOp.cycles = counts.cycles / iterations;
+    result.countsPerOp.instructions = counts.instructions / iterations;
+    result.countsPerOp.cacheMisses = counts.cacheMisses / iterations;
+    result.countsPerOp.branchMisses = counts.branchMisses / iterations;
+    results.push_back(result);
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-48s %12lld %16.1f ns/op %16.4g items/s", result.name.c_str(), result.iterations, result.nsPerOp, result.itemsPerSecond);
+    fputs(line, stdout);
+    if (perfCounters.available()) {
+        const PerfCounts &perOp = result.countsPerOp;
+        snprintf(line, sizeof(line), " %14lld cycles/op %14lld instructions/op %10lld cache-misses/op %10lld branch-misses/op", perOp.cycles, perOp.instructions, perOp.cacheMisses, perOp.branchMisses);
+        fputs(line, stdout);
+    }
+    fputs("\n", stdout);
+    fflush(stdout);
+}
+
+// Names are plain identifiers, so no escaping is needed
+void BenchmarkRunner::writeJson(std::ostream &out) const
+{
+    out << "{\n  \"perf_counters\": " << (perfCounters.available() ? "true" : "false") << ",\n";
+    out << "  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult &result = results[i];
+        out << "    {\"name\": \"" << result.name << "\""
+            << ", \"iterations\": " << result.iterations
+            << ", \"ns_per_op\": " << result.nsPerOp
+            << ", \"items_per_second\": " << result.itemsPerSecond;
+        if (perfCounters.available()) {
+            const PerfCounts &perOp = result.countsPerOp;
+            out << ", \"cycles_per_op\": " << perOp.cycles
+                << ", \"instructions_per_op\": " << perOp.instructions
+                << ", \"cache_misses_per_op\": " << perOp.cacheMisses
+                << ", \"branch_misses_per_op\": " << perOp.branchMisses;
+        }
+        out << "}";
+        out << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
@@ -0,0 +1,77 @@
+#ifndef _BENCHMARK_INCLUDE
+#define _BENCHMARK_INCLUDE
+
+#include "PerfCounters.h"
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Keeps the compiler from optimizing away a value computed by a benchmark
+template <typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchmarkResult
+{
+    std::string name;
+    long long iterations;
+    double nsPerOp;
+    double itemsPerSecond;
+    PerfCounts countsPerOp;   // Zero when the hardware counters are not available
+};
+
+// Minimal benchmark runner: every operation is repeated (doubling the number of iterations)
+// until it has run for at least minTime seconds
+// Hardware counters (if requested and available) are reported per operation
+class BenchmarkRunner
+{
+
+public:
+    BenchmarkRunner(double minTime, const std::string &filter, bool usePerfCounters);
+
+    // op processes itemsPerOp items every time it is called
+    template <typename Op>
+    void run(const std::string &name, long long itemsPerOp, Op &&op);
+
+    void writeJson(std::ostream &out) const;
+
+private:
+    bool selected(const std::string &name) const;
+    void addResult(const std::string &name, long long iterations, double seconds, long long itemsPerOp, const PerfCounts &counts);
+
+private:
+    double minTime;
+    std::string filter;
+    PerfCounters perfCounters;
+    std::vector<BenchmarkResult> results;
+};
+
+
+template <typename Op>
+void BenchmarkRunner::run(const std::string &name, long long itemsPerOp, Op &&op)
+{
+    if (!selected(name)) return;
+
+    using Clock = std::chrono::steady_clock;
+    op(); // Warm up
+
+    long long iterations = 1;
+    double seconds = 0.0;
+    PerfCounts before, after;
+    while (true) {
+        perfCounters.sample(before);
+        Clock::time_point start = Clock::now();
+        for (long long i = 0; i < iterations; ++i) op();
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        perfCounters.sample(after);
+        if (seconds >= minTime) break;
+        iterations *= 2;
+    }
+    addResult(name, iterations, seconds, itemsPerOp, after - before);
+}
+
+#endif // _BENCHMARK_INCLUDE
@@ -0,0 +1,555 @@
+#include "Benchmark.h"
+
+#include "Bvh.h"
+#include "Camera.h"
+#include "Culling.h"
+#include "DistanceSort.h"
+#include "JobSystem.h"
+#include "MeshCache.h"
+#include "Meshlets.h"
+#include "PLYReader.h"
+#include "Quadtree.h"
+#include "TraversalOrder.h"
+#include "TriangleMesh.h"
+#include "VisibilitySet.h"
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Benchmarks of the CPU hot paths, none of them needs an OpenGL context
+// Usage: micro_bench [--json <file>] [--min-time <seconds>] [--filter <substring>] [--models <directory>] [--perf-counters]
+
+static const unsigned int SEED = 42;
+
+// Camera looking at the grid from one of its corners, as in a typical path
+static void setUpCamera(Camera &camera)
+{
+    camera.init();
+    camera.resizeCameraViewport(1280, 720);
+    camera.rotateCamera(31.4f, 0.0f); // Towards the far corner of the grid
+    camera.updateFrustum();
+}
+
+// Random boxes of the size of an object spread over a grid of n x n
+static std::vector<AABB> randomBoxes(int count, int n, std::mt19937 &generator)
+{
+    std::uniform_real_distribution<float> position(0.0f, static_cast<float>(n));
+    std::vector<AABB> boxes(count);
+    for (AABB &aabb : boxes) {
+        glm::vec3 center(position(generator), 0.0f, -position(generator));
+        aabb.min = center - glm::vec3(0.5f);
+        aabb.max = center + glm::vec3(0.5f);
+    }
+    return boxes;
+}
+
+// Binary little endian PLY of a tessellated square with side x side quads (two triangles each)
+static bool writeGridModel(const std::string &filename, int side)
+{
+    std::ofstream fout(filename, std::ios_base::binary);
+    if (!fout.is_open()) return false;
+
+    int nVertices = (side + 1) * (side + 1);
+    int nFaces = 2 * side * side;
+    fout << "ply\nformat binary_little_endian 1.0\n";
+    fout << "element vertex " << nVertices << "\nproperty float x\nproperty float y\nproperty float z\n";
+    fout << "element face " << nFaces << "\nproperty list uchar int vertex_indices\nend_header\n";
+
+    std::mt19937 generator(SEED);
+    std::uniform_real_distribution<float> height(0.0f, 0.01f);
+    for (int i = 0; i <= side; ++i) {
+        for (int j = 0; j <= side; ++j) {
+            float vertex[3] = {static_cast<float>(i), height(generator), static_cast<float>(j)};
+            fout.write(reinterpret_cast<const char *>(vertex), sizeof(vertex));
+        }
+    }
+    for (int i = 0; i < side; ++i) {
+        for (int j = 0; j < side; ++j) {
+            int v0 = i * (side + 1) + j;
+            int quad[2][3] = {{v0, v0 + 1, v0 + side + 1}, {v0 + 1, v0 + side + 2, v0 + side + 1}};
+            for (const int *triangle : quad) {
+                unsigned char count = 3;
+                fout.write(reinterpret_cast<const char *>(&count), sizeof(count));
+                fout.write(reinterpret_cast<const char *>(triangle), 3 * sizeof(int));
+            }
+        }
+    }
+    return true;
+}
+
+static void benchmarkFrustumCulling(BenchmarkRunner &runner, const Camera &camera)
+{
+    const int count = 4096;
+    std::mt19937 generator(SEED);
+    std::vector<AABB> boxes = randomBoxes(count, 64, generator);
+
+    runner.run("insideFrustum/aabb/4096", count, [&]() {
+        int inside = 0;
+        for (const AABB &aabb : boxes) inside += insideFrustum(camera.getFrustum(), aabb);
+        doNotOptimize(inside);
+    });
+
+    AABB objectAABB = {glm::vec3(-0.5f), glm::vec3(0.5f)};
+    std::vector<glm::vec3> translations(count);
+    for (int i = 0; i < count; ++i) translations[i] = (boxes[i].min + boxes[i].max) / 2.0f;
+
+    runner.run("insideFrustum/translation/4096", count, [&]() {
+        int inside = 0;
+        for (const glm::vec3 &translation : translations) inside += insideFrustum(camera.getFrustum(), objectAABB, translation);
+        doNotOptimize(inside);
+    });
+}
+
+// Frustum culling of many objects on one thread and split in jobs over all the cores
+static void benchmarkParallelCulling(BenchmarkRunner &runner, const Camera &camera, JobSystem &jobs)
+{
+    const int count = 1 << 20;
+    std::mt19937 generator(SEED);
+    std::vector<AABB> boxes = randomBoxes(count, 1024, generator);
+    std::vector<unsigned char> inside(count);
+    auto cull = [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) inside[i] = insideFrustum(camera.getFrustum(), boxes[i]);
+    };
+
+    runner.run("cullObjects/serial/1048576", count, [&]() {
+        cull(0, count);
+        doNotOptimize(inside.data());
+    });
+    runner.run("cullObjects/jobs" + std::to_string(jobs.getNumThreads()) + "/1048576", count, [&]() {
+        jobs.parallelFor(0, count, 1024, cull);
+        doNotOptimize(inside.data());
+    });
+}
+
+static void benchmarkUpdateFrustum(BenchmarkRunner &runner, Camera &camera)
+{
+    runner.run("Camera::updateFrustum", 1, [&]() {
+        camera.updateFrustum();
+        doNotOptimize(camera.getFrustum());
+    });
+}
+
+// Bounding boxes of the objects of the n x n grid scene
+static std::vector<AABB> gridBoxes(int n)
+{
+    std::vector<AABB> boxes(n*n);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            glm::vec3 center(i, 0, -j);
+            boxes[i * n + j] = {center - glm::vec3(0.5f), center + glm::vec3(0.5f)};
+        }
+    }
+    return boxes;
+}
+
+static void benchmarkHierarchy(BenchmarkRunner &runner, const Camera &camera)
+{
+    for (int depth = 2; depth <= 8; depth += 2) {
+        std::vector<AABB> boxes = gridBoxes(1 << depth);
+        Quadtree quadtree;
+        quadtree.build(boxes, 0);
+        long long numNodes = quadtree.size();
+
+        runner.run("buildSceneHierarchy/depth" + std::to_string(depth), numNodes, [&]() {
+            quadtree.build(boxes, 0);
+            doNotOptimize(quadtree.bounds.data());
+        });
+
+        if (depth != 4) continue;
+
+        // Every inner node of the hierarchy used by the scene
+        long long numInner = (numNodes - 1) / 4;
+        runner.run("addChildren/sort/depth4", numInner, [&]() {
+            QuadtreeNodeIndex children[4];
+            for (QuadtreeNodeIndex i = 0; i < quadtree.size(); ++i) {
+                if (quadtree.isLeaf(i)) continue;
+                quadtree.childrenFrontToBack(i, camera.getPosition(), children);
+                doNotOptimize(children);
+            }
+        });
+    }
+
+    // Hierarchy with several objects per leaf
+    std::vector<AABB> boxes = gridBoxes(1000);
+    Quadtree quadtree;
+    quadtree.build(boxes, 0);
+    runner.run("buildSceneHierarchy/grid1000", quadtree.size(), [&]() {
+        quadtree.build(boxes, 0);
+        doNotOptimize(quadtree.bounds.data());
+    });
+}
+
+// CPU side of a CHC frame where every node turns out visible: front to back traversal of the nodes
+// inside the frustum, updating their state and pulling up the visibility (no queries)
+static long long traverseQuadtree(Quadtree &quadtree, const Camera &camera, unsigned int frame, std::vector<QuadtreeNodeIndex> &stack)
+{
+    long long visited = 0;
+    stack.push_back(quadtree.root());
+    while (!stack.empty()) {
+        QuadtreeNodeIndex i = stack.back(); stack.pop_back();
+        ++visited;
+        bool wasVisible = quadtree.isVisibleInFrame(i, frame - 1);
+        quadtree.setState(i, false, frame);
+        if (!insideFrustum(camera.getFrustum(), quadtree.getAABB(i))) continue;
+
+        for (QuadtreeNodeIndex node = i; !quadtree.isVisible(node); node = quadtree.parent(node)) {
+            quadtree.setVisible(node, true);
+            if (!quadtree.hasParent(node)) break;
+        }
+        if (quadtree.isLeaf(i) || !wasVisible) continue;
+
+        QuadtreeNodeIndex children[4];
+        int numChildren = quadtree.childrenFrontToBack(i, camera.getPosition(), children);
+        for (int k = numChildren - 1; k >= 0; --k)
+            if (!quadtree.isEmpty(children[k])) stack.push_back(children[k]);
+    }
+    return visited;
+}
+
+static void benchmarkQuadtreeLayouts(BenchmarkRunner &runner, const Camera &camera)
+{
+    const char *names[] = {"bfs", "dfs", "veb"};
+    const Quadtree::Layout layouts[] = {Quadtree::BREADTH_FIRST, Quadtree::DEPTH_FIRST, Quadtree::VAN_EMDE_BOAS};
+
+    // Depth 8, the nodes do not fit in the L2 cache
+    std::vector<AABB> boxes = gridBoxes(256);
+    for (int k = 0; k < 3; ++k) {
+        Quadtree quadtree;
+        quadtree.build(boxes, 0, layouts[k]);
+        std::vector<QuadtreeNodeIndex> stack;
+        stack.reserve(quadtree.size());
+        unsigned int frame = 1;
+        long long visited = traverseQuadtree(quadtree, camera, frame, stack);
+
+        runner.run(std::string("chcTraversal/") + names[k] + "/depth8", visited, [&]() {
+            doNotOptimize(traverseQuadtree(quadtree, camera, ++frame, stack));
+        });
+
+        runner.run(std::string("buildSceneHierarchy/") + names[k] + "/depth8", quadtree.size(), [&]() {
+            quadtree.build(boxes, 0, layouts[k]);
+            doNotOptimize(quadtree.bounds.data());
+        });
+    }
+}
+
+static void benchmarkBvh(BenchmarkRunner &runner, JobSystem &jobs)
+{
+    // With the job system the larger builds split the top levels across the cores
+    const int counts[] = {4096, 65536, 1 << 20};
+    for (int count : counts) {
+        std::mt19937 generator(SEED);
+        std::vector<AABB> boxes = randomBoxes(count, 1024, generator);
+        Bvh bvh;
+        runner.run("Bvh::build/random" + std::to_string(count), count, [&]() {
+            bvh.build(boxes, 0);
+            doNotOptimize(bvh.nodes.data());
+        });
+        runner.run("Bvh::build/jobs" + std::to_string(jobs.getNumThreads()) + "/random" + std::to_string(count), count, [&]() {
+            bvh.build(boxes, 0, &jobs);
+            doNotOptimize(bvh.nodes.data());
+        });
+    }
+
+    std::vector<AABB> boxes = gridBoxes(256);
+    Bvh bvh;
+    runner.run("Bvh::build/grid256", boxes.size(), [&]() {
+        bvh.build(boxes, 0);
+        doNotOptimize(bvh.nodes.data());
+    });
+
+    // A quarter of the objects moving, as in the animated scenes
+    std::vector<int> moved;
+    for (int i = 0; i < static_cast<int>(boxes.size()); i += 4) moved.push_back(i);
+    bvh.build(boxes, 0);
+    Quadtree quadtree;
+    quadtree.build(boxes, 0);
+    runner.run("Bvh::refit/grid256", moved.size(), [&]() {
+        bvh.refit(boxes, moved);
+        doNotOptimize(bvh.nodes.data());
+    });
+    runner.run("Quadtree::refit/grid256", moved.size(), [&]() {
+        quadtree.refit(boxes, moved);
+        doNotOptimize(quadtree.bounds.data());
+    });
+}
+
+static void benchmarkFrontToBackSort(BenchmarkRunner &runner, const Camera &camera)
+{
+    for (int n : {16, 64, 256}) {
+        std::vector<DistanceObject> unsorted;
+        unsorted.reserve(n*n);
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                glm::vec3 position(i, 0, -j);
+                unsorted.emplace_back(glm::distance(camera.getPosition(), position), i * n + j);
+            }
+        }
+
+        std::vector<DistanceObject> E;
+        E.reserve(n*n);
+        runner.run("renderAdvanced/sort/" + std::to_string(n*n), n*n, [&]() {
+            E.assign(unsorted.begin(), unsorted.end());
+            sortFrontToBack(E);
+            doNotOptimize(E.data());
+        });
+
+        // Worst case of the precomputed order, the camera crosses a cell boundary every frame
+        TraversalOrder traversalOrder;
+        traversalOrder.init(n);
+        glm::vec3 viewpoints[2] = {glm::vec3(n / 2, 0.0f, -n / 2), glm::vec3(n / 2 + 1, 0.0f, -n / 2)};
+        int frame = 0;
+        runner.run("renderAdvanced/traversalOrder/" + std::to_string(n*n), n*n, [&]() {
+            const std::vector<int> &order = traversalOrder.frontToBack(viewpoints[frame++ & 1]);
+            doNotOptimize(order.data());
+        });
+    }
+}
+
+// Sorting components for objects placed anywhere, random distances up to the far plane
+static void benchmarkDistanceSorter(BenchmarkRunner &runner)
+{
+    const char *modeNames[] = {"comparison", "radix", "approximate"};
+    for (int count : {10000, 100000, 1000000}) {
+        std::mt19937 generator(SEED);
+        std::uniform_real_distribution<float> distance(0.01f, 1000.0f);
+        std::vector<DistanceObject> unsorted(count);
+        for (int i = 0; i < count; ++i) unsorted[i] = DistanceObject(distance(generator), i);
+
+        std::vector<DistanceObject> objects;
+        objects.reserve(count);
+        for (int mode = DistanceSorter::COMPARISON; mode <= DistanceSorter::APPROXIMATE; ++mode) {
+            DistanceSorter sorter;
+            sorter.setMode(static_cast<DistanceSorter::Mode>(mode));
+            sorter.reserve(count);
+            runner.run(std::string("DistanceSorter/") + modeNames[mode] + "/" + std::to_string(count), count, [&]() {
+                objects.assign(unsorted.begin(), unsorted.end());
+                sorter.sort(objects);
+                doNotOptimize(objects.data());
+            });
+        }
+    }
+}
+
+// PVS membership and iteration, a third of the objects visible
+static void benchmarkVisibilitySet(BenchmarkRunner &runner)
+{
+    const int n = 256;
+    std::mt19937 generator(SEED);
+    std::bernoulli_distribution visible(1.0 / 3.0);
+
+    std::unordered_set<glm::ivec2> hashSet;
+    VisibilitySet bitset;
+    bitset.resize(n*n);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            if (!visible(generator)) continue;
+            hashSet.insert(glm::ivec2(i, j));
+            bitset.set(i * n + j);
+        }
+    }
+
+    runner.run("PVS/unordered_set/test/65536", n*n, [&]() {
+        int inside = 0;
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                inside += hashSet.count(glm::ivec2(i, j));
+        doNotOptimize(inside);
+    });
+
+    runner.run("PVS/bitset/test/65536", n*n, [&]() {
+        int inside = 0;
+        for (int id = 0; id < n*n; ++id) inside += bitset.test(id);
+        doNotOptimize(inside);
+    });
+
+    runner.run("PVS/bitset/forEach/65536", n*n, [&]() {
+        int sum = 0;
+        bitset.forEach([&](int id) {sum += id;});
+        doNotOptimize(sum);
+    });
+}
+
+static void benchmarkReadMesh(BenchmarkRunner &runner, const std::string &modelsDirectory, JobSystem &jobs)
+{
+    std::string smallModel = modelsDirectory + "/bunny.ply";
+    {
+        TriangleMesh mesh;
+        if (PLYReader::readMesh(smallModel, mesh)) {
+            runner.run("PLYReader::readMesh/bunny", mesh.getNumTriangles(), [&]() {
+                TriangleMesh mesh;
+                PLYReader::readMesh(smallModel, mesh);
+                doNotOptimize(mesh.aabb);
+            });
+        }
+        else std::cerr << "Skipping small model benchmark, couldn't read " << smallModel << std::endl;
+    }
+
+    std::string largeModel = "micro_bench_grid.ply";
+    const int side = 708; // ~1M triangles
+    if (writeGridModel(largeModel, side)) {
+        runner.run("PLYReader::readMesh/grid1M", 2 * side * side, [&]() {
+            TriangleMesh mesh;
+            PLYReader::readMesh(largeModel, mesh);
+            doNotOptimize(mesh.aabb);
+        });
+        runner.run("PLYReader::readMesh/jobs" + std::to_string(jobs.getNumThreads()) + "/grid1M", 2 * side * side, [&]() {
+            TriangleMesh mesh;
+            PLYReader::readMesh(largeModel, mesh, &jobs);
+            doNotOptimize(mesh.aabb);
+        });
+
+        // What MeshLoader::load does before the upload, which is stood in for by a copy of the vertex buffer to
+        // memory of its own: cold start parses the model, sorts its triangles into meshlets and builds the vertex
+        // buffer and builds the meshlets (without writing the cache), warm start maps the cache and reads its vertex
+        // buffer through that copy and its meshlets. The files stay in the page cache, so it is a warm start of the
+        // process, not of the OS
+        std::vector<float> upload;
+        runner.run("MeshCache/cold/grid1M", 2 * side * side, [&]() {
+            TriangleMesh mesh;
+            std::vector<float> vertexBuffer;
+            Meshlets meshlets;
+            PLYReader::readMesh(largeModel, mesh, &jobs);
+            mesh.sortMeshletTriangles();
+            mesh.buildVertexBuffer(vertexBuffer);
+            meshlets.build(vertexBuffer.data(), 3 * mesh.getNumTriangles(), mesh.getVertexSize());
+            upload.assign(vertexBuffer.begin(), vertexBuffer.end());
+            doNotOptimize(upload.data());
+            doNotOptimize(meshlets);
+        });
+        TriangleMesh mesh;
+        std::vector<float> vertexBuffer;
+        PLYReader::readMesh(largeModel, mesh);
+        mesh.sortMeshletTriangles();
+        mesh.buildVertexBuffer(vertexBuffer);
+        Meshlets meshlets;
+        meshlets.build(vertexBuffer.data(), 3 * mesh.getNumTriangles(), mesh.getVertexSize());
+        if (MeshCache::store(largeModel, mesh, vertexBuffer, meshlets)) {
+            runner.run("MeshCache/warm/grid1M", 2 * side * side, [&]() {
+                CachedMesh cached;
+                MeshCache::open(largeModel, cached);
+                upload.assign(cached.vertexBuffer, cached.vertexBuffer + cached.numVertices * cached.vertexSize);
+                doNotOptimize(upload.data());
+                doNotOptimize(cached.meshlets);
+            });
+            std::remove(MeshCache::cachePath(largeModel).c_str());
+        }
+        std::remove(largeModel.c_str());
+    }
+    else std::cerr << "Skipping large model benchmark, couldn't write " << largeModel << std::endl;
+}
+
+// Meshlets of the copies of the bunny in a 16 x 16 grid, as culled when they are drawn
+static void benchmarkMeshlets(BenchmarkRunner &runner, const Camera &camera, const std::string &modelsDirectory)
+{
+    std::string model = modelsDirectory + "/bunny.ply";
+    TriangleMesh mesh;
+    if (!PLYReader::readMesh(model, mesh)) {
+        std::cerr << "Skipping meshlet benchmarks, couldn't read " << model << std::endl;
+        return;
+    }
+    mesh.sortMeshletTriangles();
+    std::vector<float> vertexBuffer;
+    mesh.buildVertexBuffer(vertexBuffer);
+    int numVertices = 3 * mesh.getNumTriangles();
+
+    Meshlets meshlets;
+    runner.run("Meshlets::build/bunny", mesh.getNumTriangles(), [&]() {
+        meshlets.build(vertexBuffer.data(), numVertices, mesh.getVertexSize());
+        doNotOptimize(meshlets.size());
+    });
+
+    const int n = 16;
+    CameraSnapshot snapshot = camera.getSnapshot();
+    std::vector<unsigned char> visible(meshlets.size());
+    std::vector<GLint> first(meshlets.size());
+    std::vector<GLsizei> count(meshlets.size());
+    runner.run("Meshlets::cull/bunny/16x16", static_cast<long long>(n) * n * meshlets.size(), [&]() {
+        long long triangles = 0;
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(i, 0, -j));
+                int numTriangles, numCulled;
+                meshlets.cull(model, snapshot, 0, visible.data(), first.data(), count.data(), numTriangles, numCulled);
+                triangles += numTriangles;
+            }
+        }
+        doNotOptimize(triangles);
+    });
+
+    // As draw commands, all the instances of a frame one after the other as in the stream buffer
+    std::vector<DrawArraysCommand> commands(static_cast<std::size_t>(n) * n * meshlets.size());
+    runner.run("Meshlets::cull/bunny/16x16/commands", static_cast<long long>(n) * n * meshlets.size(), [&]() {
+        std::size_t numCommands = 0;
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(i, 0, -j));
+                int numTriangles, numCulled;
+                numCommands += meshlets.cull(model, snapshot, 0, visible.data(), commands.data() + numCommands,
+                                             numTriangles, numCulled);
+            }
+        }
+        doNotOptimize(numCommands);
+    });
+}
+
+int main(int argc, char **argv)
+{
+    std::string jsonPath;
+    std::string filter;
+    std::string modelsDirectory = "../models";
+    double minTime = 0.5;
+    bool usePerfCounters = false;
+
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--json") == 0 && hasValue) jsonPath = argv[++i];
+        else if (strcmp(argv[i], "--filter") == 0 && hasValue) filter = argv[++i];
+        else if (strcmp(argv[i], "--models") == 0 && hasValue) modelsDirectory = argv[++i];
+        else if (strcmp(argv[i], "--min-time") == 0 && hasValue) minTime = atof(argv[++i]);
+        else if (strcmp(argv[i], "--perf-counters") == 0) usePerfCounters = true;
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--json <file>] [--min-time <seconds>] [--filter <substring>] [--models <directory>] [--perf-counters]" << std::endl;
+            return 1;
+        }
+    }
+
+    // PLYReader is quite verbose
+    std::cout.setstate(std::ios_base::failbit);
+
+    static Camera camera;
+    setUpCamera(camera);
+
+    BenchmarkRunner runner(minTime, filter, usePerfCounters);
+    JobSystem jobs;
+    benchmarkFrustumCulling(runner, camera);
+    benchmarkUpdateFrustum(runner, camera);
+    benchmarkParallelCulling(runner, camera, jobs);
+    benchmarkHierarchy(runner, camera);
+    benchmarkQuadtreeLayouts(runner, camera);
+    benchmarkBvh(runner, jobs);
+    benchmarkFrontToBackSort(runner, camera);
+    benchmarkDistanceSorter(runner);
+    benchmarkVisibilitySet(runner);
+    benchmarkReadMesh(runner, modelsDirectory, jobs);
+    benchmarkMeshlets(runner, camera, modelsDirectory);
+
+    if (!jsonPath.empty()) {
+        std::ofstream fout(jsonPath);
+        if (!fout.is_open()) {
+            std::cerr << "Couldn't write " << jsonPath << std::endl;
+            return 1;
+        }
+        runner.writeJson(fout);
+    }
+    return 0;
+}
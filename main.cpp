@@ -163,6 +163,13 @@ int main(int argc, char **argv)
 {
     // GLUT initialization
     glutInit(&argc, argv);
+
+    // Remaining arguments are ours (GLUT removes the ones it understands)
+    CommandLineOptions options;
+    if (!parseCommandLine(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
     glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
     glutInitWindowPosition(100, 100);
     glutInitWindowSize(640, 480);
@@ -192,7 +199,7 @@ int main(int argc, char **argv)
     glewInit();
 
     // Application instance initialization
-    Application::instance().init();
+    Application::instance().init(options);
     prevTime = glutGet(GLUT_ELAPSED_TIME);
     // GLUT gains control of the application
     glutMainLoop();
@@ -5,6 +5,7 @@
 // e: Eye space
 
 in vec3 eNormal;
+in vec4 vColor;
 
 uniform vec4 color;
 uniform int bLighting;
@@ -25,7 +26,7 @@ void main()
         lighting = 0.15 * ambient + 0.85 * diffuse;
     }
 
-    // Modulate color with lighting and apply gamma correction
-    fragColor = pow(lighting * color, vec4(1.0 / 2.1));
+    // Modulate color (of the instance and of the vertex) with lighting and apply gamma correction
+    fragColor = pow(lighting * color * vColor, vec4(1.0 / 2.1));
 }
 
@@ -2,6 +2,7 @@
 
 in vec3 mPos;
 in vec3 mNormal;
+in vec4 mColor;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -9,11 +10,13 @@ uniform mat4 projection;
 uniform mat3 normalMatrix;
 
 out vec3 eNormal;
+out vec4 vColor;
 
 void main()
 {
   // Transform matrix to viewspace
   eNormal = normalMatrix * mNormal;
+  vColor = mColor;
 	gl_Position = projection * view * model * vec4(mPos, 1.0);
 }
 
@@ -0,0 +1,11 @@
+#version 330 core
+
+// Object id plus one, zero is left for the background and the occluders
+uniform uint objectId;
+
+out uint fragId;
+
+void main()
+{
+    fragId = objectId;
+}
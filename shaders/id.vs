@@ -0,0 +1,12 @@
+#version 330 core
+
+in vec3 mPos;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(mPos, 1.0);
+}